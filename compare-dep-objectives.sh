@@ -0,0 +1,36 @@
+#!/bin/bash
+# Сравнение целевых функций синтаксической части (negative sampling и hierarchical softmax) на одном корпусе:
+# обучаются две модели с одинаковыми параметрами, для каждой выводится скорость обучения и показатели самодиагностики.
+# Словари должны быть построены заранее (см. demo-linux.sh), дополнительные параметры обучения передаются аргументами скрипта, например:
+#   ./compare-dep-objectives.sh -iter 3 -negative_d 4
+
+SIZE_DEP=60
+SIZE_ASSOC=40
+TRAIN_FN=parus_first_10m_lines.conll
+COL_CTX_D=3
+USE_DEPREL=1
+VOC_M=main.vocab
+VOC_D=ctx_dep.vocab
+THREADS=8
+OBJECTIVES="ns hs"
+
+for OBJ in $OBJECTIVES; do
+  echo ""
+  echo "TRAINING EMBEDDINGS -- OBJECTIVE $OBJ"
+  ./conll2vec -task train -train $TRAIN_FN \
+              -vocab_l $VOC_M -vocab_d $VOC_D -col_ctx_d $COL_CTX_D -use_deprel $USE_DEPREL -model vectors_$OBJ.c2v \
+              -size_d $SIZE_DEP -size_a $SIZE_ASSOC -threads $THREADS -objective_d $OBJ "$@" > train_$OBJ.log 2>&1 || { cat train_$OBJ.log; exit 1; }
+  ./conll2vec -task selftest_ru -model vectors_$OBJ.c2v > selftest_$OBJ.log 2>&1
+done
+
+echo ""
+echo "SUMMARY"
+for OBJ in $OBJECTIVES; do
+  echo ""
+  echo "objective_d = $OBJ"
+  # итоговая скорость -- последний отчет о прогрессе (отчеты разделены возвратом каретки)
+  tr '\r' '\n' < train_$OBJ.log | grep -o "Words/sec: [^ ]*" | tail -n 1 | sed 's/^/  /'
+  tr '\r' '\n' < train_$OBJ.log | grep -o "time elapsed: .*" | tail -n 1 | sed 's/^/  training /'
+  # синтаксические тесты самодиагностики и общие показатели RUSSE/RuSim
+  grep -E "^Run test_|AVG =|^  (HJ|RT|AE|AE2)$|Use |Spearman's|average_precision =|RuSim" selftest_$OBJ.log | grep -v "warn:"
+done
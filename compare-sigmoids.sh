@@ -0,0 +1,36 @@
+#!/bin/bash
+# Сравнение способов вычисления логистической функции (табличного и полиномиального) на одном корпусе:
+# обучаются две модели с одинаковыми параметрами, для каждой выводится скорость обучения и показатели самодиагностики.
+# Словари должны быть построены заранее (см. demo-linux.sh), дополнительные параметры обучения передаются аргументами скрипта, например:
+#   ./compare-sigmoids.sh -iter 3 -negative_d 10
+
+SIZE_DEP=60
+SIZE_ASSOC=40
+TRAIN_FN=parus_first_10m_lines.conll
+COL_CTX_D=3
+USE_DEPREL=1
+VOC_M=main.vocab
+VOC_D=ctx_dep.vocab
+THREADS=8
+SIGMOIDS="table poly"
+
+for SIG in $SIGMOIDS; do
+  echo ""
+  echo "TRAINING EMBEDDINGS -- SIGMOID $SIG"
+  ./conll2vec -task train -train $TRAIN_FN \
+              -vocab_l $VOC_M -vocab_d $VOC_D -col_ctx_d $COL_CTX_D -use_deprel $USE_DEPREL -model vectors_$SIG.c2v \
+              -size_d $SIZE_DEP -size_a $SIZE_ASSOC -threads $THREADS -sigmoid $SIG "$@" > train_$SIG.log 2>&1 || { cat train_$SIG.log; exit 1; }
+  ./conll2vec -task selftest_ru -model vectors_$SIG.c2v > selftest_$SIG.log 2>&1
+done
+
+echo ""
+echo "SUMMARY"
+for SIG in $SIGMOIDS; do
+  echo ""
+  echo "sigmoid = $SIG"
+  # итоговая скорость -- последний отчет о прогрессе (отчеты разделены возвратом каретки)
+  tr '\r' '\n' < train_$SIG.log | grep -o "Words/sec: [^ ]*" | tail -n 1 | sed 's/^/  /'
+  tr '\r' '\n' < train_$SIG.log | grep -o "time elapsed: .*" | tail -n 1 | sed 's/^/  training /'
+  # синтаксические тесты самодиагностики и общие показатели RUSSE/RuSim
+  grep -E "^Run test_|AVG =|^  (HJ|RT|AE|AE2)$|Use |Spearman's|average_precision =|RuSim" selftest_$SIG.log | grep -v "warn:"
+done
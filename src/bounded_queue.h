@@ -0,0 +1,100 @@
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+
+// Блокирующая очередь ограниченной емкости (несколько писателей, несколько читателей).
+// Писатель ждет, пока в очереди не освободится место; читатель ждет, пока в очереди не появится элемент.
+// После закрытия очереди новые элементы не принимаются, а читатели выбирают оставшиеся и получают признак окончания.
+// Элементами обычно являются пакеты (например, пакеты предложений), чтобы затраты на синхронизацию делились на весь пакет.
+template <typename T>
+class BoundedQueue
+{
+public:
+  // статистика очереди (глубина замеряется при каждом добавлении; ожидания показывают, какая сторона конвейера медленнее)
+  struct Stats
+  {
+    uint64_t pushes = 0;
+    uint64_t push_waits = 0;   // добавления, ожидавшие освобождения места (читатели не успевают)
+    uint64_t pop_waits = 0;    // извлечения, ожидавшие появления элемента (писатели не успевают)
+    uint64_t depth_sum = 0;
+    size_t max_depth = 0;
+    double avg_depth() const { return pushes ? static_cast<double>(depth_sum) / pushes : 0.0; }
+  };
+  explicit BoundedQueue(size_t queue_capacity)
+  : capacity(queue_capacity > 0 ? queue_capacity : 1)
+  {
+  }
+  // добавление элемента (false -- очередь закрыта)
+  bool push(T&& item)
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if ( !closed && items.size() >= capacity )
+      ++stats.push_waits;
+    not_full.wait(lock, [this]() { return closed || items.size() < capacity; });
+    if ( closed )
+      return false;
+    items.push_back( std::move(item) );
+    ++stats.pushes;
+    stats.depth_sum += items.size();
+    stats.max_depth = std::max(stats.max_depth, items.size());
+    lock.unlock();
+    not_empty.notify_one();
+    return true;
+  } // method-end
+  // извлечение элемента (false -- очередь закрыта и пуста)
+  bool pop(T& item)
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if ( !closed && items.empty() )
+      ++stats.pop_waits;
+    not_empty.wait(lock, [this]() { return closed || !items.empty(); });
+    if ( items.empty() )
+      return false;
+    item = std::move( items.front() );
+    items.pop_front();
+    lock.unlock();
+    not_full.notify_one();
+    return true;
+  } // method-end
+  // закрытие очереди (будит всех ожидающих)
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      closed = true;
+    }
+    not_empty.notify_all();
+    not_full.notify_all();
+  } // method-end
+  // повторное открытие пустой очереди (например, перед очередной эпохой)
+  void reopen()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    items.clear();
+    closed = false;
+  } // method-end
+  // статистика с момента создания очереди
+  Stats get_stats()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    return stats;
+  } // method-end
+private:
+  size_t capacity;
+  std::deque<T> items;
+  bool closed = false;
+  Stats stats;
+  std::mutex mtx;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+}; // class-decl-end
+
+
+#endif /* BOUNDED_QUEUE_H_ */
@@ -31,6 +31,11 @@ public:
   bool parse(int argc, char **argv)
   {
     const std::vector<std::string> args_vector(argv, argv + argc);
+    return parse(args_vector);
+  }
+  // парсер параметров, заданных списком строк (например, строкой из файла конфигураций)
+  bool parse(const std::vector<std::string>& args_vector)
+  {
     std::string last_acceptable_arg;
     for (auto&& arg : args_vector)
     {
@@ -12,7 +12,8 @@ public:
     params_ = {
         {"-task",         {"Values: fit, vocab, train, sim, ...", std::nullopt, std::nullopt}},
         {"-model",        {"The model <file>", std::nullopt, std::nullopt}},
-        {"-train",        {"Training data <file>.conll", std::nullopt, std::nullopt}},
+        {"-train",        {"Training data <file>.conll, directory, glob or @manifest of shards (or stdin)", std::nullopt, std::nullopt}},
+        {"-train_cmd",    {"Shell <command> printing training data (re-run in every epoch)", std::nullopt, std::nullopt}},
         {"-vocab_l",      {"Lemmas vocabulary <file>", std::nullopt, std::nullopt}},
         {"-vocab_t",      {"Tokens vocabulary <file>", std::nullopt, std::nullopt}},
         {"-tl_map",       {"Tokens-lemmas mapping <file>", "token2lemmas.map", std::nullopt}},
@@ -20,11 +21,27 @@ public:
         {"-vocab_e",      {"Expressions vocabulary <file>", "./data/mwe.list", std::nullopt}},
         {"-vocab_d",      {"Dependency contexts vocabulary <file>", std::nullopt, std::nullopt}},
         {"-backup",       {"Save neural network weights to <file>", std::nullopt, std::nullopt}},
+        {"-train_cfgs",   {"Several models configurations <file> (one pass training)", std::nullopt, std::nullopt}},
         {"-restore",      {"Restore neural network weights from <file>", std::nullopt, std::nullopt}},
+        {"-delta",        {"Delta <file> of rows changed by toks_train (output of toks_train, input of apply_delta)", std::nullopt, std::nullopt}},
+        {"-restore_model",{"Previous model <file> for incremental training", std::nullopt, std::nullopt}},
+        {"-dist_nodes",   {"Number of nodes in distributed training", "1", std::nullopt}},
+        {"-dist_rank",    {"This node index in distributed training (0 -- master)", "0", std::nullopt}},
+        {"-dist_master",  {"Master node <host>:<port> for distributed training", "127.0.0.1:7700", std::nullopt}},
+        {"-dist_sync",    {"Words processed by node between synchronizations", "1000000", std::nullopt}},
+        {"-dry_run",      {"Print memory and time projection for training and exit 0|1", "0", std::nullopt}},
+        {"-conflict_stat",{"Sample hogwild write conflicts in every <int>-th time slice (0 -- off)", "0", std::nullopt}},
+        {"-mmap_net",     {"Keep neural network weights in memory-mapped files <prefix>.*", std::nullopt, std::nullopt}},
         {"-min-count_l",  {"Min frequency in Lemmas vocabulary", "50", std::nullopt}},
         {"-min-count_t",  {"Min frequency in Tokens vocabulary", "50", std::nullopt}},
         {"-min-count_d",  {"Min frequency in Dependency vocabulary", "50", std::nullopt}},
         {"-min-count_o",  {"Min frequency in OOV vocabulary", "10000", std::nullopt}},
+        {"-vocab_passes", {"Corpus passes while building vocabularies (1 -- single pass with deferred sentences containing MWEs) 1|2", "2", std::nullopt}},
+        {"-vocab_sample", {"Build vocabularies from a sample of <float> of corpus (0 -- exact build over whole corpus)", "0", std::nullopt}},
+        {"-vocab_sample_z",{"Min-count margin in standard deviations of sampled frequency estimate", "2", std::nullopt}},
+        {"-vocab_mem",    {"Memory for approximate (heavy hitters) frequency counting while building vocabularies (MB, 0 -- exact counting)", "0", std::nullopt}},
+        {"-vocab_recount",{"Exact recount of heavy hitters candidates in additional corpus pass 0|1", "0", std::nullopt}},
+        {"-vocab_spill",  {"Memory limit for exact vocabulary counting, exceeding vocabularies are spilled to disk (MB, 0 -- no limit)", "0", std::nullopt}},
         {"-exclude_nums", {"Exclude digital numbers while fitting", "0", std::nullopt}},
         {"-max_oov_sfx",  {"Maximal suffix length in OOV vocabulary", "5", std::nullopt}},
         {"-col_ctx_d",    {"Dependency contexts vocabulary column (in conll)", "3", std::nullopt}},
@@ -34,16 +51,22 @@ public:
         {"-size_g",       {"Size of Grammatical part of word vectors", "20", std::nullopt}},
         {"-negative_d",   {"Number of negative examples (dependency)", "5", std::nullopt}},
         {"-negative_a",   {"Number of negative examples (associative)", "5", std::nullopt}},
+        {"-objective_d",  {"Dependency objective: negative sampling or hierarchical softmax (ns|hs)", "ns", std::nullopt}},
         {"-alpha_d",      {"Max learning rate (dependency)", "0.025", std::nullopt}},
         {"-alpha_a",      {"Max learning rate (associative)", "0.025", std::nullopt}},
+        {"-gramm_dedup",  {"Train grammatical embeddings on deduplicated examples table 0|1", "0", std::nullopt}},
         {"-alpha_g",      {"Max learning rate (grammatical)", "0.025", std::nullopt}},
+        {"-adagrad",      {"Per-row adaptive learning rates (AdaGrad) 0|1", "0", std::nullopt}},
+        {"-sigmoid",      {"Sigmoid computation (table|poly)", "table", std::nullopt}},
         {"-inflection",   {"Alpha inflection point [0, 1]", "0.15", std::nullopt}},
         {"-iter",         {"Run more training iterations", "5", std::nullopt}},
         {"-sample_w",     {"Words subsampling threshold", "1e-4", std::nullopt}},
         {"-sample_d",     {"Dependency contexts subsampling threshold", "1e-4", std::nullopt}},
         {"-sample_a",     {"Associative contexts subsampling threshold", "1e-5", std::nullopt}},
         {"-threads",      {"Use <int> threads", "8", std::nullopt}},
-        {"-fit_input",    {"<file>.conll to fit (or stdin)", std::nullopt, std::nullopt}},
+        {"-fit_input",    {"<file>.conll (directory, glob or @manifest of shards) to fit (or stdin)", std::nullopt, std::nullopt}},
+        {"-dedup_near",   {"Remove near-duplicate sentences too (MinHash on lemma shingles) 0|1", "0", std::nullopt}},
+        {"-dedup_mem",    {"Memory for sentence fingerprints (MB)", "1024", std::nullopt}},
         {"-a_ratio",      {"Associations contribution to similarity", "1.0", std::nullopt}},
         {"-g_ratio",      {"Grammatics contribution to similarity", "0.1", std::nullopt}},
         {"-st_yo",        {"Replace 'yo' in russe while self-testing", "0", std::nullopt}},
@@ -58,7 +81,8 @@ public:
         {"-rr_vocab",     {"Reliable rel-pairs vocabulary <file>", std::nullopt, std::nullopt}},
         {"-rr_min_sim",   {"Reliable rel-pairs minimal similarity", "0.6", std::nullopt}},
         {"-ca_vocab",     {"Safe lemmas vocabulary <file>", std::nullopt, std::nullopt}},
-        {"-vocabs_tab",   {"External vocabs table <file>", "./data/vocabs.table", std::nullopt}}
+        {"-vocabs_tab",   {"External vocabs table <file>", "./data/vocabs.table", std::nullopt}},
+        {"-ext_workers",  {"Dedicated threads applying external vocabs data (0 -- inline)", "0", std::nullopt}}
 
     };
   }
@@ -0,0 +1,250 @@
+#ifndef CONFLICT_SAMPLER_H_
+#define CONFLICT_SAMPLER_H_
+
+#include "ostream_state_guard.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+#include <iomanip>
+
+
+// Измерение конфликтов записи при асинхронном (hogwild) обучении: насколько часто разные потоки одновременно
+// обновляют одну и ту же строку весовой матрицы.
+// Обновления регистрируются не все, а только в выборочных интервалах времени (каждый period-й интервал длиной ~1 мс),
+// но в этих интервалах -- всеми потоками, поэтому одновременные обновления попадают в выборку парами.
+// Каждый поток пишет записи в собственный кольцевой буфер (один писатель, один читатель, без блокировок),
+// поток-анализатор периодически выбирает записи из всех буферов, упорядочивает их по времени и считает коллизии
+// (записи последних REORDER_DELAY_NS наносекунд откладываются до следующего прохода, т.к. запись с более ранним временем
+// может еще не попасть в буфер своего потока):
+// обновление строки считается конфликтным, если предыдущее обновление той же строки выполнено другим потоком не ранее,
+// чем COLLISION_WINDOW_NS наносекунд назад. Статистика ведется по частотным диапазонам (строки словарей упорядочены
+// по убыванию частоты, диапазон -- десятичный порядок номера строки) и по подпространствам.
+class ConflictSampler
+{
+public:
+  // обновляемые подпространства
+  enum Target : uint8_t
+  {
+    ctSyn0Dep = 0,    // категориальная часть векторов слов
+    ctSyn0Assoc,      // ассоциативная часть векторов слов
+    ctSyn1Dep,        // вектора синтаксических контекстов
+    ctLast
+  };
+  static constexpr size_t SLICE_SHIFT = 20;               // длина интервала выборки -- 2^20 нс (~1 мс)
+  static constexpr uint64_t COLLISION_WINDOW_NS = 1000;   // окно одновременности
+  static constexpr size_t BANDS_COUNT = 8;                // частотные диапазоны: 1-9, 10-99, ..., 10^7 и далее
+  static constexpr size_t RING_CAPACITY = 1 << 16;        // емкость буфера потока (записей)
+  static constexpr uint64_t REORDER_DELAY_NS = 20000000;  // задержка анализа записей для их упорядочивания между проходами (20 мс)
+  static constexpr size_t MAX_THREADS = 65536;            // номер потока хранится в 16 битах
+
+  struct Record
+  {
+    uint64_t time_ns;
+    uint32_t row;
+    uint8_t target;
+    uint16_t thread;
+  };
+
+  // кольцевой буфер потока обучения
+  class Ring
+  {
+  public:
+    Ring(uint16_t thread_no, size_t slices_period)
+    : records(RING_CAPACITY)
+    , thread(thread_no)
+    , period(slices_period)
+    {
+    }
+    // вызывается перед обработкой обучающего примера: попадает ли пример в выборочный интервал
+    inline void begin_example()
+    {
+      active = ( (now_ns() >> SLICE_SHIFT) % period == 0 );
+    }
+    inline void push(Target target, size_t row)
+    {
+      if ( !active )
+        return;
+      const size_t h = head.load(std::memory_order_relaxed);
+      if ( h - tail.load(std::memory_order_acquire) >= RING_CAPACITY )
+      {
+        ++dropped;
+        return;
+      }
+      records[h & (RING_CAPACITY - 1)] = Record{ now_ns(), static_cast<uint32_t>(row), target, thread };
+      head.store(h + 1, std::memory_order_release);
+    }
+    // выборка накопленных записей (вызывается только анализатором)
+    void drain(std::vector<Record>& result)
+    {
+      const size_t h = head.load(std::memory_order_acquire);
+      size_t t = tail.load(std::memory_order_relaxed);
+      for (; t != h; ++t)
+        result.push_back( records[t & (RING_CAPACITY - 1)] );
+      tail.store(t, std::memory_order_release);
+    }
+    uint64_t get_dropped() const
+    {
+      return dropped;
+    }
+  private:
+    std::vector<Record> records;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    uint64_t dropped = 0;
+    bool active = false;
+    uint16_t thread;
+    size_t period;
+  }; // class-decl-end: Ring
+
+  ConflictSampler(size_t threads_count, size_t slices_period)
+  {
+    for (size_t i = 0; i < threads_count; ++i)
+      rings.push_back( std::make_unique<Ring>(i, std::max<size_t>(1, slices_period)) );
+  }
+  ~ConflictSampler()
+  {
+    stop();
+  }
+  Ring* ring(size_t thread_idx)
+  {
+    return rings[thread_idx].get();
+  } // method-end
+  // запуск потока-анализатора
+  void start()
+  {
+    stopping = false;
+    analyzer = std::thread(&ConflictSampler::analyzer_entry_point, this);
+  } // method-end
+  // остановка анализатора (после завершения потоков обучения)
+  void stop()
+  {
+    if ( !analyzer.joinable() )
+      return;
+    stopping = true;
+    analyzer.join();
+  } // method-end
+  void report() const
+  {
+    static const char* TARGET_NAMES[ctLast] = { "syn0 (dep part)", "syn0 (assoc part)", "syn1_dep" };
+    uint64_t dropped = 0;
+    for (auto& r : rings)
+      dropped += r->get_dropped();
+    OstreamStateGuard cout_state(std::cout);
+    std::cout << std::endl << "Hogwild write conflicts (updates of a row by another thread within " << COLLISION_WINDOW_NS << " ns)" << std::endl;
+    std::cout << "  SUBSPACE            ROWS               UPDATES      CONFLICTS   RATE" << std::endl;
+    for (size_t t = 0; t < ctLast; ++t)
+    {
+      uint64_t t_updates = 0, t_collisions = 0;
+      for (size_t b = 0; b < BANDS_COUNT; ++b)
+      {
+        t_updates += updates[t][b];
+        t_collisions += collisions[t][b];
+        if ( updates[t][b] == 0 )
+          continue;
+        std::cout << "  " << std::left << std::setw(20) << TARGET_NAMES[t] << std::setw(18) << band_name(b)
+                  << std::right << std::setw(8) << updates[t][b] << std::setw(15) << collisions[t][b]
+                  << std::setw(9) << std::fixed << std::setprecision(3) << 100.0 * collisions[t][b] / updates[t][b] << "%" << std::endl;
+      }
+      if ( t_updates > 0 )
+        std::cout << "  " << std::left << std::setw(20) << TARGET_NAMES[t] << std::setw(18) << "all"
+                  << std::right << std::setw(8) << t_updates << std::setw(15) << t_collisions
+                  << std::setw(9) << std::fixed << std::setprecision(3) << 100.0 * t_collisions / t_updates << "%" << std::endl;
+    }
+    if ( dropped > 0 )
+      std::cout << "  (records dropped on full buffers: " << dropped << ")" << std::endl;
+  } // method-end
+private:
+  std::vector< std::unique_ptr<Ring> > rings;
+  std::thread analyzer;
+  std::atomic<bool> stopping{false};
+  uint64_t updates[ctLast][BANDS_COUNT] = {};
+  uint64_t collisions[ctLast][BANDS_COUNT] = {};
+  // последнее зарегистрированное обновление строки: время и номер потока
+  std::unordered_map< uint64_t, std::pair<uint64_t, uint16_t> > last_update;
+  // текущий интервал выборки (водяной знак: не уменьшается, запоздавшие записи прошедших интервалов не сбрасывают историю)
+  uint64_t current_slice = 0;
+
+  static inline uint64_t now_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+  } // method-end
+  static size_t band(uint32_t row)
+  {
+    size_t b = 0;
+    for (uint64_t bound = 10; b + 1 < BANDS_COUNT && row + 1 >= bound; bound *= 10)
+      ++b;
+    return b;
+  } // method-end
+  static std::string band_name(size_t b)
+  {
+    uint64_t from = 1;
+    for (size_t i = 0; i < b; ++i)
+      from *= 10;
+    return (b + 1 < BANDS_COUNT) ? std::to_string(from) + "-" + std::to_string(from * 10 - 1) : std::to_string(from) + "+";
+  } // method-end
+  void analyzer_entry_point()
+  {
+    const std::chrono::milliseconds DRAIN_PAUSE(5);
+    // записи, отложенные с предыдущего прохода, и новые записи сортируются вместе
+    std::vector<Record> batch;
+    while ( true )
+    {
+      // признак остановки читается до выборки, чтобы последний проход забрал все записи
+      const bool last_pass = stopping.load();
+      const uint64_t drain_ns = now_ns();
+      for (auto& r : rings)
+        r->drain(batch);
+      std::sort(batch.begin(), batch.end(), [](const Record& a, const Record& b) { return a.time_ns < b.time_ns; });
+      // анализируются только записи старше задержки упорядочивания (в последнем проходе -- все)
+      size_t ready = batch.size();
+      if ( !last_pass )
+        ready = std::lower_bound( batch.begin(), batch.end(), drain_ns - std::min(drain_ns, REORDER_DELAY_NS),
+                                  [](const Record& a, uint64_t t) { return a.time_ns < t; } ) - batch.begin();
+      for (size_t i = 0; i < ready; ++i)
+        analyze(batch[i]);
+      batch.erase(batch.begin(), batch.begin() + ready);
+      if ( last_pass )
+        break;
+      std::this_thread::sleep_for(DRAIN_PAUSE);
+    }
+  } // method-end
+  void analyze(const Record& rec)
+  {
+    // интервалы выборки разделены паузами -- при переходе к новому интервалу история обновлений не нужна
+    const uint64_t slice = rec.time_ns >> SLICE_SHIFT;
+    if ( slice > current_slice )
+    {
+      last_update.clear();
+      current_slice = slice;
+    }
+    const size_t b = band(rec.row);
+    ++updates[rec.target][b];
+    // запись прошедшего интервала (запоздавшая сверх задержки упорядочивания): его история уже сброшена
+    if ( slice < current_slice )
+      return;
+    const uint64_t key = (static_cast<uint64_t>(rec.target) << 32) | rec.row;
+    auto it = last_update.find(key);
+    if ( it == last_update.end() )
+    {
+      last_update.emplace(key, std::make_pair(rec.time_ns, rec.thread));
+      return;
+    }
+    // записи соседних выборок могут слегка перекрываться по времени, поэтому берется модуль разности
+    const uint64_t prev_ns = it->second.first;
+    const uint64_t delta = (rec.time_ns > prev_ns) ? rec.time_ns - prev_ns : prev_ns - rec.time_ns;
+    if ( it->second.second != rec.thread && delta < COLLISION_WINDOW_NS )
+      ++collisions[rec.target][b];
+    it->second = std::make_pair(rec.time_ns, rec.thread);
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* CONFLICT_SAMPLER_H_ */
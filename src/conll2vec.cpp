@@ -1,12 +1,15 @@
 #include "command_line_parameters_defs.h"
 #include "simple_profiler.h"
 #include "fit_parus.h"
+#include "corpus_dedup.h"
 #include "vocabs_builder.h"
 #include "original_word2vec_vocabulary.h"
 #include "external_vocabs_manager.h"
 #include "mwe_vocabulary.h"
 #include "learning_example_provider.h"
 #include "trainer.h"
+#include "dry_run_planner.h"
+#include "trainers_group.h"
 #include "sim_estimator.h"
 #include "selftest_ru.h"
 #include "add_punct.h"
@@ -41,6 +44,31 @@ std::shared_ptr<SimilarityEstimator> create_sim_estimator(const CommandLineParam
   return sim_estimator;
 }
 
+// проверка источника обучающего множества: файл (-train), stdin (-train stdin, однократное чтение) или вывод команды (-train_cmd)
+bool check_train_input(const CommandLineParametersDefs& cmdLineParams)
+{
+  if ( !cmdLineParams.isDefined("-train") && !cmdLineParams.isDefined("-train_cmd") )
+  {
+    std::cerr << "Trainset is not defined." << std::endl;
+    return false;
+  }
+  if ( cmdLineParams.isDefined("-train") && cmdLineParams.isDefined("-train_cmd") )
+  {
+    std::cerr << "-train and -train_cmd can't be used together." << std::endl;
+    return false;
+  }
+  if ( cmdLineParams.isDefined("-train") && cmdLineParams.getAsString("-train") == "stdin" && cmdLineParams.getAsInt("-iter") > 1 )
+  {
+    std::cerr << "stdin trainset can be read only once (use -iter 1 or -train_cmd)." << std::endl;
+    return false;
+  }
+  // корпус может состоять из нескольких частей (каталог, шаблон имени или манифест)
+  std::vector<std::string> files;
+  if ( cmdLineParams.isDefined("-train") && cmdLineParams.getAsString("-train") != "stdin" && !CorpusShards::resolve(cmdLineParams.getAsString("-train"), files) )
+    return false;
+  return true;
+}
+
 
 
 int main(int argc, char **argv)
@@ -56,6 +84,7 @@ int main(int argc, char **argv)
     std::cerr << "Task parameter is not defined." << std::endl;
     std::cerr << "Alternatives:" << std::endl
               << "  -task fit         -- conll file transformation" << std::endl
+              << "  -task dedup       -- remove duplicate sentences from conll file" << std::endl
               << "  -task vocab       -- vocabs building" << std::endl
               << "  -task train       -- lemmas model training" << std::endl
               << "  -task sim         -- similarity test" << std::endl
@@ -63,6 +92,7 @@ int main(int argc, char **argv)
               << "  -task punct       -- add punctuation to model" << std::endl
               << "  -task toks        -- add tokens to model" << std::endl
               << "  -task toks_train  -- train tokens model" << std::endl
+              << "  -task apply_delta -- apply tokens training delta to model" << std::endl
               << "  -task toks_gramm  -- train grammatical embeddings and append them to model" << std::endl
               << "  -task import      -- import from word2vec model" << std::endl
               << "  -task export      -- export to word2vec model" << std::endl
@@ -77,6 +107,11 @@ int main(int argc, char **argv)
     return -1;
   }
   auto&& task = cmdLineParams.getAsString("-task");
+  if ( cmdLineParams.isDefined("-mmap_net") && !MmapMatrix::is_supported() )
+  {
+    std::cerr << "-mmap_net is not supported on this platform." << std::endl;
+    return -1;
+  }
 
   // если поставлена задача преобразования conll-файла
   if (task == "fit")
@@ -86,11 +121,55 @@ int main(int argc, char **argv)
     return 0;
   }
 
+  // если поставлена задача удаления дубликатов предложений
+  if (task == "dedup")
+  {
+    if ( !cmdLineParams.isDefined("-fit_input") || !cmdLineParams.isDefined("-train") )
+    {
+      std::cerr << "-fit_input and -train parameters must be defined." << std::endl;
+      return -1;
+    }
+    SimpleProfiler global_profiler;
+    CorpusDedup dedup( cmdLineParams.getAsInt("-threads"), (cmdLineParams.getAsInt("-dedup_near") == 1), cmdLineParams.getAsInt("-dedup_mem") );
+    return dedup.run( cmdLineParams.getAsString("-fit_input"), cmdLineParams.getAsString("-train") ) ? 0 : -1;
+  }
+
   // если поставлена задача построения словарей
   if (task == "vocab")
   {
     SimpleProfiler global_profiler;
     VocabsBuilder vb;
+    float sample = cmdLineParams.getAsFloat("-vocab_sample");
+    if ( sample < 0 || sample > 1 )
+    {
+      std::cerr << "-vocab_sample must be in [0, 1]." << std::endl;
+      return -1;
+    }
+    if ( sample > 0 && sample < 1 )
+      vb.set_sampling( sample, cmdLineParams.getAsFloat("-vocab_sample_z") );
+    vb.set_single_pass( cmdLineParams.getAsInt("-vocab_passes") == 1 );
+    if ( cmdLineParams.getAsInt("-vocab_mem") < 0 )
+    {
+      std::cerr << "-vocab_mem must be non-negative." << std::endl;
+      return -1;
+    }
+    if ( cmdLineParams.getAsInt("-vocab_recount") == 1 && cmdLineParams.getAsInt("-vocab_passes") == 1 )
+    {
+      std::cerr << "-vocab_recount requires two-pass vocabulary building (-vocab_passes 2)." << std::endl;
+      return -1;
+    }
+    vb.set_memory_limit( cmdLineParams.getAsInt("-vocab_mem"), (cmdLineParams.getAsInt("-vocab_recount") == 1) );
+    if ( cmdLineParams.getAsInt("-vocab_spill") < 0 )
+    {
+      std::cerr << "-vocab_spill must be non-negative." << std::endl;
+      return -1;
+    }
+    if ( cmdLineParams.getAsInt("-vocab_spill") > 0 && cmdLineParams.getAsInt("-vocab_mem") > 0 )
+    {
+      std::cerr << "-vocab_spill and -vocab_mem are mutually exclusive." << std::endl;
+      return -1;
+    }
+    vb.set_spill_limit( cmdLineParams.getAsInt("-vocab_spill") );
     bool succ = vb.build_vocabs( cmdLineParams.getAsString("-train"),
                                  cmdLineParams.getAsString("-vocab_l"), cmdLineParams.getAsString("-vocab_t"),
                                  cmdLineParams.getAsString("-tl_map"), cmdLineParams.getAsString("-vocab_o"), cmdLineParams.getAsString("-vocab_d"),
@@ -107,26 +186,108 @@ int main(int argc, char **argv)
   // если поставлена задача обучения модели
   if (task == "train")
   {
-    if ( !cmdLineParams.isDefined("-train") )
+    if ( !check_train_input(cmdLineParams) )
+      return -1;
+    if ( !cmdLineParams.isDefined("-vocab_l") )
     {
-      std::cerr << "Trainset is not defined." << std::endl;
+      std::cerr << "-vocab_l parameter must be defined." << std::endl;
       return -1;
     }
-    if ( !cmdLineParams.isDefined("-model") )
+    // конфигурации обучаемых моделей (несколько -- при обучении группы моделей за один проход по корпусу)
+    std::vector<CommandLineParametersDefs> configs;
+    if ( cmdLineParams.isDefined("-train_cfgs") )
     {
-      std::cerr << "-model parameter must be defined." << std::endl;
+      if ( !TrainersGroup::load_configs(cmdLineParams.getAsString("-train_cfgs"), cmdLineParams, configs) )
+        return -1;
+    }
+    else
+      configs.push_back(cmdLineParams);
+    // дообучение ранее построенной модели на новых данных (с расширением словаря)
+    bool incremental = cmdLineParams.isDefined("-restore_model");
+    if ( incremental && configs.size() > 1 )
+    {
+      std::cerr << "-restore_model can't be combined with -train_cfgs." << std::endl;
       return -1;
     }
-    if ( !cmdLineParams.isDefined("-vocab_l") )
+    // в режиме иерархического softmax строки правой матрицы соответствуют узлам дерева Хаффмана, а не контекстам,
+    // поэтому ее нельзя ни сохранить для дообучения, ни восстановить по словам
+    for (auto& cfg : configs)
     {
-      std::cerr << "-vocab_l parameter must be defined." << std::endl;
+      const std::string objective_d = cfg.getAsString("-objective_d");
+      if ( objective_d != "ns" && objective_d != "hs" )
+      {
+        std::cerr << "Unknown -objective_d value: " << objective_d << std::endl;
+        return -1;
+      }
+      if ( objective_d == "hs" && (incremental || cfg.isDefined("-backup")) )
+      {
+        std::cerr << "-objective_d hs can't be combined with -backup or -restore_model." << std::endl;
+        return -1;
+      }
+    }
+    // распределенное обучение (несколько процессов, каждый обучается на своей части корпуса)
+    const size_t dist_nodes = cmdLineParams.getAsInt("-dist_nodes");
+    const size_t dist_rank = cmdLineParams.getAsInt("-dist_rank");
+    if ( dist_rank >= dist_nodes )
+    {
+      std::cerr << "-dist_rank must be less than -dist_nodes." << std::endl;
       return -1;
     }
-    if ( cmdLineParams.getAsInt("-size_d") > 0 && !cmdLineParams.isDefined("-vocab_d") ) // устанавливая -size_d 0, можно строить только ассоциативную модель
+    if ( dist_nodes > 1 )
     {
-      std::cerr << "-vocab_d parameter must be defined." << std::endl;
+      if ( configs.size() > 1 )
+      {
+        std::cerr << "Distributed training can't be combined with -train_cfgs." << std::endl;
+        return -1;
+      }
+      if ( cmdLineParams.isDefined("-train_cmd") || cmdLineParams.getAsString("-train") == "stdin" )
+      {
+        std::cerr << "Distributed training requires a trainset file." << std::endl;
+        return -1;
+      }
+      if ( !DistributedSync::is_supported() )
+      {
+        std::cerr << "Distributed training is not supported on this platform." << std::endl;
+        return -1;
+      }
+    }
+    // данные внешних словарей можно применять в выделенных потоках (по темпу обучения), а не внутри обучающих примеров
+    const size_t ext_workers = cmdLineParams.getAsInt("-ext_workers");
+    if ( ext_workers > 0 && configs.size() > 1 )
+    {
+      std::cerr << "-ext_workers can't be combined with -train_cfgs." << std::endl;
+      return -1;
+    }
+    if ( cmdLineParams.getAsInt("-conflict_stat") > 0 && configs.size() > 1 )
+    {
+      std::cerr << "-conflict_stat can't be combined with -train_cfgs." << std::endl;
       return -1;
     }
+    if ( cmdLineParams.getAsInt("-conflict_stat") > 0 && static_cast<size_t>(cmdLineParams.getAsInt("-threads")) > ConflictSampler::MAX_THREADS )
+    {
+      std::cerr << "-conflict_stat supports at most " << ConflictSampler::MAX_THREADS << " threads." << std::endl;
+      return -1;
+    }
+    bool needLoadDepCtxVocab = false;
+    bool needLoadAssocCtxVocab = false;
+    for (auto& cfg : configs)
+    {
+      if ( !cfg.isDefined("-model") )
+      {
+        std::cerr << "-model parameter must be defined." << std::endl;
+        return -1;
+      }
+      if ( cfg.getAsInt("-size_d") > 0 && !cfg.isDefined("-vocab_d") ) // устанавливая -size_d 0, можно строить только ассоциативную модель
+      {
+        std::cerr << "-vocab_d parameter must be defined." << std::endl;
+        return -1;
+      }
+      needLoadDepCtxVocab = needLoadDepCtxVocab || (cfg.getAsInt("-size_d") > 0);
+      needLoadAssocCtxVocab = needLoadAssocCtxVocab || (cfg.getAsInt("-size_a") > 0);
+    }
+    // оценка потребности в памяти и длительности обучения (без загрузки словарей и выделения весовых матриц)
+    if ( cmdLineParams.getAsInt("-dry_run") == 1 )
+      return DryRunPlanner::run(cmdLineParams, configs) ? 0 : -1;
 
     SimpleProfiler global_profiler;
 
@@ -136,11 +297,22 @@ int main(int argc, char **argv)
     v_main = std::make_shared<OriginalWord2VecVocabulary>();
     if ( !v_main->load( cmdLineParams.getAsString("-vocab_l") ) )
       return -1;
+    // при дообучении словарь новых данных дополняется словами предыдущей модели (чтобы они не выпали из модели)
+    VectorsModel prev_vm;
+    if ( incremental )
+    {
+      if ( !prev_vm.load( cmdLineParams.getAsString("-restore_model") ) )
+        return -1;
+      if ( prev_vm.dep_size != static_cast<size_t>(cmdLineParams.getAsInt("-size_d")) || prev_vm.assoc_size != static_cast<size_t>(cmdLineParams.getAsInt("-size_a")) )
+      {
+        std::cerr << "-restore_model dimensions differ from -size_d/-size_a." << std::endl;
+        return -1;
+      }
+      std::cout << "Words appended from previous model: " << v_main->append_missing(prev_vm) << std::endl;
+    }
     v_mwe = std::make_shared<MweVocabulary>( );
     if ( !v_mwe->load( cmdLineParams.getAsString("-vocab_e"), v_main ) )
       return -1;
-    bool needLoadDepCtxVocab = (cmdLineParams.getAsInt("-size_d") > 0);
-    bool needLoadAssocCtxVocab = (cmdLineParams.getAsInt("-size_a") > 0);
     if (needLoadDepCtxVocab)
     {
       v_dep_ctx = std::make_shared<OriginalWord2VecVocabulary>();
@@ -163,6 +335,16 @@ int main(int argc, char **argv)
         return -1;
       if ( !ext_vocab_manager->load_vocabs(v_main) )
         return -1;
+      // данные внешних словарей общие для всех моделей группы -- их измерения должны укладываться в размерность каждой модели
+      auto max_dim = ext_vocab_manager->get_max_dim();
+      for (auto& cfg : configs)
+      {
+        if ( max_dim && max_dim.value() >= static_cast<size_t>(cfg.getAsInt("-size_d") + cfg.getAsInt("-size_a")) )
+        {
+          std::cerr << "External vocabs dimensions are out of model size: " << cfg.getAsString("-model") << std::endl;
+          return -1;
+        }
+      }
     }
 
     // создание поставщика обучающих примеров
@@ -170,51 +352,120 @@ int main(int argc, char **argv)
     std::shared_ptr< LearningExampleProvider> lep = std::make_shared< LearningExampleProvider > ( cmdLineParams,
                                                                                                   v_main, false, v_dep_ctx, v_assoc_ctx, v_mwe,
                                                                                                   2, false, 0,
-                                                                                                  ext_vocab_manager
+                                                                                                  (ext_workers > 0 ? nullptr : ext_vocab_manager)
                                                                                                 );
 
-    // создаем объект, организующий обучение
-    Trainer trainer( lep, v_main, false, v_dep_ctx, v_assoc_ctx,
-                     cmdLineParams.getAsInt("-size_d"),
-                     cmdLineParams.getAsInt("-size_a"),
-                     0,
-                     cmdLineParams.getAsInt("-iter"),
-                     cmdLineParams.getAsFloat("-alpha_d"),
-                     cmdLineParams.getAsFloat("-alpha_a"),
-                     std::numeric_limits<float>::quiet_NaN(),
-                     cmdLineParams.getAsFloat("-inflection"),
-                     cmdLineParams.getAsInt("-negative_d"),
-                     cmdLineParams.getAsInt("-negative_a"),
-                     cmdLineParams.getAsInt("-threads") );
-
-    // инициализация нейросети
-    trainer.create_net();
-    trainer.init_net();
+    // создаем объекты, организующие обучение (по одному на каждую конфигурацию)
+    std::vector< std::shared_ptr<Trainer> > trainers;
+    for (auto& cfg : configs)
+    {
+      trainers.push_back( std::make_shared<Trainer>( lep, v_main, false,
+                                                     (cfg.getAsInt("-size_d") > 0 ? v_dep_ctx : nullptr),
+                                                     (cfg.getAsInt("-size_a") > 0 ? v_assoc_ctx : nullptr),
+                                                     cfg.getAsInt("-size_d"),
+                                                     cfg.getAsInt("-size_a"),
+                                                     0,
+                                                     cfg.getAsInt("-iter"),
+                                                     cfg.getAsFloat("-alpha_d"),
+                                                     cfg.getAsFloat("-alpha_a"),
+                                                     std::numeric_limits<float>::quiet_NaN(),
+                                                     // при дообучении (если не задано иное) скорость обучения убывает с самого начала, без фазы разгона
+                                                     ( incremental && !cfg.isDefined("-inflection") ) ? 0.0 : cfg.getAsFloat("-inflection"),
+                                                     cfg.getAsInt("-negative_d"),
+                                                     cfg.getAsInt("-negative_a"),
+                                                     cfg.getAsInt("-threads") ) );
+      // весовые матрицы можно разместить в отображаемых в память файлах (для словарей, не помещающихся в ОЗУ)
+      if ( cmdLineParams.isDefined("-mmap_net") )
+        trainers.back()->set_mmap_storage( cmdLineParams.getAsString("-mmap_net") + (configs.size() > 1 ? "." + std::to_string(trainers.size()-1) : "") );
+      if ( cfg.getAsString("-objective_d") == "hs" )
+        trainers.back()->set_dep_hierarchical_softmax();
+      // инициализация нейросети
+      trainers.back()->create_net();
+      trainers.back()->init_net();
+      if ( cfg.getAsInt("-adagrad") == 1 )
+        trainers.back()->enable_adagrad();
+      trainers.back()->set_poly_sigmoid( cfg.getAsString("-sigmoid") == "poly" );
+    }
+    // перенос весов предыдущей модели (строки сопоставляются по словам; новые слова и контексты сохраняют начальную инициализацию)
+    if ( incremental )
+    {
+      if ( !trainers.front()->restore_left_matrix_by_model(prev_vm) )
+        return -1;
+      if ( v_dep_ctx && cmdLineParams.isDefined("-restore") )
+      {
+        if ( !trainers.front()->restore_right_matrix_by_words( cmdLineParams.getAsString("-restore") ) )
+          return -1;
+      }
+      else if ( v_dep_ctx )
+        std::cerr << "Warning: -restore is not defined, dependency contexts matrix is trained from scratch." << std::endl;
+      prev_vm.clear();
+    }
+    if ( dist_nodes > 1 )
+    {
+      auto ds = std::make_shared<DistributedSync>( dist_nodes, dist_rank, cmdLineParams.getAsString("-dist_master"), cmdLineParams.getAsInt("-dist_sync") );
+      if ( !trainers.front()->set_distributed(ds) )
+        return -1;
+    }
 
     // запускаем потоки, осуществляющие обучение
     size_t threads_count = cmdLineParams.getAsInt("-threads");
     std::vector<std::thread> threads_vec;
     threads_vec.reserve(threads_count);
+    std::unique_ptr<TrainersGroup> group = (trainers.size() > 1) ? std::make_unique<TrainersGroup>(trainers) : nullptr;
+    if ( ext_workers > 0 && ext_vocab_manager )
+      trainers.front()->start_ext_workers(ext_vocab_manager, ext_workers);
+    // измерение конфликтов записи между потоками (только при обучении одной модели)
+    std::shared_ptr<ConflictSampler> conflicts;
+    if ( cmdLineParams.getAsInt("-conflict_stat") > 0 )
+    {
+      conflicts = std::make_shared<ConflictSampler>( threads_count, cmdLineParams.getAsInt("-conflict_stat") );
+      trainers.front()->set_conflict_sampler(conflicts);
+      conflicts->start();
+    }
     for (size_t i = 0; i < threads_count; ++i)
-      threads_vec.emplace_back(&Trainer::train_entry_point, &trainer, i);
+    {
+      if (group)
+        threads_vec.emplace_back(&TrainersGroup::train_entry_point, group.get(), i);
+      else
+        threads_vec.emplace_back(&Trainer::train_entry_point, trainers.front().get(), i);
+    }
     // ждем завершения обучения
     for (size_t i = 0; i < threads_count; ++i)
       threads_vec[i].join();
+    trainers.front()->stop_ext_workers();
+    if ( conflicts )
+    {
+      conflicts->stop();
+      conflicts->report();
+    }
+    if ( !trainers.front()->distributed_finish() )
+      return -1;
+    // по завершении распределенного обучения матрицы всех узлов совпадают, модель сохраняет ведущий узел
+    if ( dist_rank != 0 )
+      return 0;
 
     // вычисление взвешенного среднего между вектором слова и векторами связанных с ним временных словосочетаний (для которых данное слово является синтакс. вершиной)
-    if ( cmdLineParams.getAsInt("-mwe_collapse") == 1 )
+    std::vector< std::vector< std::pair<size_t, float> > > collapsing_info;
+    for (size_t i = 0; i < configs.size(); ++i)
     {
-      std::vector< std::vector< std::pair<size_t, float> > > collapsing_info;
-      v_mwe->process_transient(v_main, collapsing_info);
-      trainer.vectors_weighted_collapsing(collapsing_info);
-      // TODO: сделать удаление временных словосочетаний из модели
+      if ( configs[i].getAsInt("-mwe_collapse") == 1 )
+      {
+        if ( collapsing_info.empty() )
+          v_mwe->process_transient(v_main, collapsing_info);
+        trainers[i]->vectors_weighted_collapsing(collapsing_info);
+        // TODO: сделать удаление временных словосочетаний из модели
+      }
     }
 
     // сохраняем вычисленные вектора в файл
-    if (cmdLineParams.isDefined("-model"))
-      trainer.saveEmbeddings( cmdLineParams.getAsString("-model") );
-    if (cmdLineParams.isDefined("-backup"))
-      trainer.backup( cmdLineParams.getAsString("-backup"), false, true );
+    for (size_t i = 0; i < configs.size(); ++i)
+    {
+      trainers[i]->prepare_saving();
+      if (configs[i].isDefined("-model"))
+        trainers[i]->saveEmbeddings( configs[i].getAsString("-model") );
+      if (configs[i].isDefined("-backup"))
+        trainers[i]->backup( configs[i].getAsString("-backup"), false, true );
+    }
 
     //trainer.print_training_stat();
     return 0;
@@ -258,11 +509,8 @@ int main(int argc, char **argv)
   // если поставлена задача доучивания модели токенов
   if (task == "toks_train")
   {
-    if ( !cmdLineParams.isDefined("-train") )
-    {
-      std::cerr << "Trainset is not defined." << std::endl;
+    if ( !check_train_input(cmdLineParams) )
       return -1;
-    }
     if ( !cmdLineParams.isDefined("-model") )
     {
       std::cerr << "-model parameter must be defined." << std::endl;
@@ -340,10 +588,18 @@ int main(int argc, char **argv)
                      cmdLineParams.getAsInt("-threads") );
 
     // инициализация нейросети
+    if ( cmdLineParams.isDefined("-mmap_net") )
+      trainer.set_mmap_storage( cmdLineParams.getAsString("-mmap_net") );
     trainer.create_net();
+    if ( cmdLineParams.getAsInt("-adagrad") == 1 )
+      trainer.enable_adagrad();
+    trainer.set_poly_sigmoid( cmdLineParams.getAsString("-sigmoid") == "poly" );
     trainer.init_net();  // начальная инициализация левой матрицы случайными значениями
     trainer.restore_left_matrix_by_model(vm);  // перенос векторых представлений из загруженной модели в левую матрицу
     trainer.restore( cmdLineParams.getAsString("-restore"), false, true );
+    // при сохранении дельты отслеживаем измененные строки
+    if ( cmdLineParams.isDefined("-delta") )
+      trainer.track_touched_rows();
 
     // запускаем потоки, осуществляющие обучение
     size_t threads_count = cmdLineParams.getAsInt("-threads");
@@ -355,14 +611,36 @@ int main(int argc, char **argv)
     for (size_t i = 0; i < threads_count; ++i)
       threads_vec[i].join();
 
-    // сохраняем вычисленные вектора в файл
+    // сохраняем вычисленные вектора в файл (либо только изменения относительно исходной модели, которая остается нетронутой)
+    trainer.prepare_saving();
+    if ( cmdLineParams.isDefined("-delta") )
+      return trainer.saveDelta( cmdLineParams.getAsString("-delta"), vm ) ? 0 : -1;
     trainer.saveEmbeddings( cmdLineParams.getAsString("-model"), &vm );
     return 0;
   } // if task == toks_train
 
+  // если поставлена задача наложения дельты на модель
+  if (task == "apply_delta")
+  {
+    if ( !cmdLineParams.isDefined("-delta") )
+    {
+      std::cerr << "-delta parameter must be defined." << std::endl;
+      return -1;
+    }
+    VectorsModel vm;
+    if ( !vm.load(cmdLineParams.getAsString("-model")) )
+      return -1;
+    if ( !vm.apply_delta(cmdLineParams.getAsString("-delta")) )
+      return -1;
+    vm.save(cmdLineParams.getAsString("-model"));
+    return 0;
+  } // if task == apply_delta
+
   // если поставлена задача добавления в модель грамматических эмбеддингов
   if (task == "toks_gramm")
   {
+    if ( !check_train_input(cmdLineParams) )
+      return -1;
     // загрузим модель
     VectorsModel vm;
     if ( !vm.load(cmdLineParams.getAsString("-model")) )
@@ -397,17 +675,26 @@ int main(int argc, char **argv)
                      cmdLineParams.getAsInt("-negative_a"),
                      cmdLineParams.getAsInt("-threads") );
 
+    trainer.set_poly_sigmoid( cmdLineParams.getAsString("-sigmoid") == "poly" );
     // инициализация нейросети
     trainer.create_and_init_gramm_net();
 
     size_t threads_count = cmdLineParams.getAsInt("-threads");
+    // обучение по дедуплицированной таблице примеров (вместо многократного чтения корпуса)
+    const bool dedup = ( cmdLineParams.getAsInt("-gramm_dedup") == 1 );
+    if ( dedup )
+    {
+      SimpleProfiler table_profiler;
+      trainer.build_gramm_table();
+      std::cout << "Examples table building finished.";
+    }
     // запускаем потоки, осуществляющие обучение
     {
       SimpleProfiler train_profiler;
       std::vector<std::thread> threads_vec;
       threads_vec.reserve(threads_count);
       for (size_t i = 0; i < threads_count; ++i)
-        threads_vec.emplace_back(&Trainer::train_entry_point__gramm, &trainer, i);
+        threads_vec.emplace_back(dedup ? &Trainer::train_entry_point__gramm_table : &Trainer::train_entry_point__gramm, &trainer, i);
       // ждем завершения обучения
       for (size_t i = 0; i < threads_count; ++i)
         threads_vec[i].join();
@@ -2,11 +2,21 @@
 #define CONLL_READER_H_
 
 #include "str_conv.h"
+#include "corpus_shards.h"
 
 #include <string>
+#include <cstring>       // for std::strerror
 #include <vector>
 #include <algorithm>
 #include <fstream>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+
+#ifdef _MSC_VER
+  #define popen _popen
+  #define pclose _pclose
+#endif
 
 
 enum Conll
@@ -45,14 +55,26 @@ public:
     delete[] buf;
   }
   // инициализация
+  // (имя файла может задавать корпус из нескольких частей -- см. CorpusShards; части читаются подряд, как один файл)
   bool init()
   {
     idx_in_buf = BUF_SIZE;
     real_buf_len = BUF_SIZE;
+    file_pos = 0;
+    stop_pos = NO_STOP;
     if ( filename == "stdin" )
+    {
+      files.clear();
+      file_idx = 0;
       f = stdin;
+    }
     else
-      f = fopen(filename.c_str(), "rb");
+    {
+      if ( !CorpusShards::resolve(filename, files) )
+        return false;
+      file_idx = 0;
+      f = fopen(files[file_idx].c_str(), "rb");
+    }
     if ( f == nullptr )
     {
       std::cerr << "ConllReader error: " << std::strerror(errno) << std::endl;
@@ -60,49 +82,60 @@ public:
     }
     return true;
   }
-  // инициализация (версия для многопоточного чтения)
-  bool init_multithread(size_t thread_no, size_t threads_count)
+  // инициализация для чтения вывода внешней команды (например, распаковщика: "gzip -dc corpus.conll.gz")
+  bool init_command(const std::string& command)
   {
     idx_in_buf = BUF_SIZE;
     real_buf_len = BUF_SIZE;
-    uint64_t f_size = 0;
-    try {
-      f_size = get_file_size();
-    } catch (const std::runtime_error& e) {
-      std::cerr << "ConllReader can't get file size for: " << filename << "\n  " << e.what() << std::endl;
-      return false;
-    }
-    if (f_size == 0)
-    {
-      std::cerr << "ConllReader: empty file" << std::endl;
-      return false;
-    }
-    f = fopen(filename.c_str(), "rb");
+    file_pos = 0;
+    stop_pos = NO_STOP;
+    f = popen(command.c_str(), "r");
     if ( f == nullptr )
     {
-      std::cerr << "ConllReader error: " << std::strerror(errno) << std::endl;
+      std::cerr << "ConllReader can't run command: " << command << "\n  " << std::strerror(errno) << std::endl;
       return false;
     }
-    if ( thread_no != 0 )
-    {
-      int succ = fseek(f, f_size / threads_count * thread_no, SEEK_SET);
-      if (succ != 0)
-      {
-        std::cerr << "ConllReader error: " << std::strerror(errno) << std::endl;
-        return false;
-      }
-      // т.к. после смещения мы типично не оказываемся в начале предложения, выполним выравнивание на начало предложения
-      SentenceMatrix stub;
-      read_sentence(stub); // один read_sentence не гарантирует выход на начало предложения, т.к. fseek может поставить нас прямо на перевод строки в конце очередного токена, что распознается, как пустая строка
-      stub.clear();
-      read_sentence(stub);
-    }
+    from_command = true;
     return true;
   }
+  // инициализация (версия для многопоточного чтения)
+  // корпус из нескольких частей рассматривается как их конкатенация: поток начинает чтение с той же доли общего объема,
+  // что и для одного файла, и при исчерпании части продолжает со следующей (так потоки читают разные части параллельно)
+  bool init_multithread(size_t thread_no, size_t threads_count)
+  {
+    stop_pos = NO_STOP;
+    if ( !resolve_sizes() )
+      return false;
+    return open_at( (thread_no != 0) ? total_size / threads_count * thread_no : 0 );
+  }
+  // инициализация для чтения одного фрагмента корпуса (корпус делится на chunks_count фрагментов равного объема)
+  // читаются предложения, начинающиеся в пределах фрагмента (фрагменты в совокупности покрывают корпус без пропусков и повторов)
+  bool init_chunk(size_t chunk_no, size_t chunks_count)
+  {
+    if ( !resolve_sizes() )
+      return false;
+    stop_pos = (chunk_no + 1 < chunks_count) ? total_size / chunks_count * (chunk_no + 1) : NO_STOP;
+    return open_at( (chunk_no != 0) ? total_size / chunks_count * chunk_no : 0 );
+  }
+  // суммарный объем корпуса в байтах (известен после init_multithread или init_chunk)
+  uint64_t get_total_size() const
+  {
+    return total_size;
+  }
   // финализация
   void fin()
   {
-    fclose( f );
+    if ( f == nullptr )
+      return;
+    if ( from_command )
+    {
+      int status = pclose( f );
+      if ( status != 0 )
+        std::cerr << "ConllReader: command exited with status " << status << std::endl;
+      from_command = false;
+    }
+    else
+      fclose( f );
     f = nullptr;
   }
   // чтение предложения
@@ -112,7 +145,8 @@ public:
     if ( !f ) return false;
     while ( true )
     {
-      if ( idx_in_buf == real_buf_len && feof(f) ) return false; // больше нечего читать
+      if ( idx_in_buf == real_buf_len && feof(f) && !has_next_file() ) return false; // больше нечего читать
+      if ( stop_pos != NO_STOP && position() >= stop_pos ) return false; // достигнута граница фрагмента
       if ( ferror(f) ) return false; // больше нет возможности читать
       if ( !read_sentence_internal(result) ) continue; // невалидные предложения пропускаем
       if ( result.empty() ) continue; // пустые предложения пропускаем
@@ -143,8 +177,11 @@ public:
   } // method-end
 
 private:
-  // имя conll-файла для чтения
+  // имя conll-файла для чтения (или спецификация корпуса из нескольких частей)
   std::string filename;
+  // файлы корпуса и номер читаемого файла
+  std::vector<std::string> files;
+  size_t file_idx = 0;
   // файловый дескриптор
   FILE* f = nullptr;
   // буфер для чтения
@@ -156,17 +193,148 @@ private:
   size_t real_buf_len = BUF_SIZE;
   // выполнять ли дополнительные проверки корректности входных данных
   bool use_sentence_validators = false;
+  // данные читаются из вывода внешней команды (закрывается через pclose)
+  bool from_command = false;
+  // размеры частей корпуса, их смещения в конкатенации и суммарный объем
+  std::vector<uint64_t> sizes;
+  std::vector<uint64_t> offsets;
+  uint64_t total_size = 0;
+  // смещение в текущем файле, соответствующее концу прочитанного в буфер
+  uint64_t file_pos = 0;
+  // граница читаемого фрагмента (смещение в конкатенации частей)
+  static constexpr uint64_t NO_STOP = std::numeric_limits<uint64_t>::max();
+  uint64_t stop_pos = NO_STOP;
+  // минимальный объем чтения вблизи границы фрагмента (чтобы дочитать последнее предложение)
+  static constexpr size_t CHUNK_TAIL_READ = 64 * 1024;
 
 
   // получение размера файла
-  uint64_t get_file_size()
+  uint64_t get_file_size(const std::string& fn)
   {
     // TODO: в будущем использовать std::experimental::filesystem::file_size
-    std::ifstream ifs(filename, std::ios::binary|std::ios::ate);
+    std::ifstream ifs(fn, std::ios::binary|std::ios::ate);
     if ( !ifs.good() )
         throw std::runtime_error(std::strerror(errno));
     return ifs.tellg();
   } // method-end
+  // определение размеров частей корпуса
+  bool resolve_sizes()
+  {
+    idx_in_buf = BUF_SIZE;
+    real_buf_len = BUF_SIZE;
+    if ( !CorpusShards::resolve(filename, files) )
+      return false;
+    sizes.clear();
+    offsets.clear();
+    total_size = 0;
+    for (auto& fn : files)
+    {
+      try {
+        sizes.push_back( get_file_size(fn) );
+      } catch (const std::runtime_error& e) {
+        std::cerr << "ConllReader can't get file size for: " << fn << "\n  " << e.what() << std::endl;
+        return false;
+      }
+      offsets.push_back(total_size);
+      total_size += sizes.back();
+    }
+    if (total_size == 0)
+    {
+      std::cerr << "ConllReader: empty file" << std::endl;
+      return false;
+    }
+    return true;
+  } // method-end
+  // открытие корпуса с заданного смещения в конкатенации частей (с выравниванием на начало предложения)
+  bool open_at(uint64_t start_pos)
+  {
+    // определяем часть, в которую попадает начальная позиция
+    file_idx = 0;
+    while ( file_idx + 1 < files.size() && start_pos >= sizes[file_idx] )
+      start_pos -= sizes[file_idx++];
+    f = fopen(files[file_idx].c_str(), "rb");
+    if ( f == nullptr )
+    {
+      std::cerr << "ConllReader error: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+    file_pos = 0;
+    if ( start_pos != 0 && !align_to_sentence(start_pos) )
+      return false;
+    return true;
+  } // method-end
+  // выравнивание на начало предложения: переход к первой позиции не ранее start_pos (смещение в текущем файле),
+  // с которой начинается строка, следующая за пустой (или к началу следующей части корпуса);
+  // предыдущий фрагмент читает ровно те предложения, что начинаются раньше этой позиции, поэтому фрагменты не пересекаются
+  bool align_to_sentence(uint64_t start_pos)
+  {
+    // просматриваем три байта перед start_pos, чтобы распознать пустую строку ("\n\n" или "\n\r\n") прямо перед ней
+    const uint64_t scan_pos = start_pos - std::min<uint64_t>(start_pos, 3);
+    if ( fseek(f, scan_pos, SEEK_SET) != 0 )
+    {
+      std::cerr << "ConllReader error: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+    file_pos = scan_pos;
+    idx_in_buf = BUF_SIZE;
+    real_buf_len = BUF_SIZE;
+    bool line_known = (scan_pos == 0);   // известно ли, что текущая строка просматривается с начала
+    bool line_start = line_known;        // находимся в начале строки
+    bool prev_blank = line_known;        // предыдущая строка пуста (начало файла приравнивается к пустой строке)
+    bool cur_blank = true;               // текущая строка пока пуста (допускается только '\r')
+    uint64_t pos = scan_pos;
+    while ( !(pos >= start_pos && line_start && prev_blank) )
+    {
+      if ( idx_in_buf == real_buf_len )
+      {
+        if ( feof(f) || ferror(f) )
+        {
+          // часть корпуса закончилась: следующее предложение начинается со следующей части
+          if ( !ferror(f) && has_next_file() )
+            next_file();
+          return !ferror(f);
+        }
+        fill_buf();
+        continue;
+      }
+      char c = buf[idx_in_buf++];
+      ++pos;
+      if ( c == '\n' )
+      {
+        prev_blank = line_known && cur_blank;
+        line_known = true;
+        line_start = true;
+        cur_blank = true;
+      }
+      else
+      {
+        if ( c != '\r' )
+          cur_blank = false;
+        line_start = false;
+      }
+    }
+    return true;
+  } // method-end
+  // чтение очередной порции файла в буфер
+  void fill_buf()
+  {
+    // при чтении фрагмента не читаем в буфер далеко за его границу
+    size_t to_read = BUF_SIZE;
+    if ( stop_pos != NO_STOP )
+    {
+      const uint64_t pos = offsets[file_idx] + file_pos;
+      const uint64_t rest = (stop_pos > pos) ? stop_pos - pos : 0;
+      to_read = static_cast<size_t>( std::min<uint64_t>(BUF_SIZE, std::max<uint64_t>(rest, CHUNK_TAIL_READ)) );
+    }
+    idx_in_buf = 0;
+    real_buf_len = fread( buf, sizeof(buf[0]), to_read, f );
+    file_pos += real_buf_len;
+  } // method-end
+  // текущая позиция чтения в конкатенации частей корпуса
+  uint64_t position() const
+  {
+    return offsets[file_idx] + file_pos - (real_buf_len - idx_in_buf);
+  } // method-end
   // чтение строки
   void read_line(FILE *f, std::string& result)
   {
@@ -175,10 +343,17 @@ private:
     {
       if ( idx_in_buf == real_buf_len )
       {
-        if ( feof(f) || ferror(f) )
+        if ( ferror(f) )
           return;
-        idx_in_buf = 0;
-        real_buf_len = fread( buf, sizeof(buf[0]), BUF_SIZE, f );
+        if ( feof(f) )
+        {
+          // конец части корпуса: незавершенная строка и предложение завершаются на границе файлов
+          if ( !result.empty() || !has_next_file() )
+            return;
+          next_file();
+          return;
+        }
+        fill_buf();
       }
       // согласно принципам кодирования https://ru.wikipedia.org/wiki/UTF-8, никакой другой символ не может содержать в себе байт 0x0A
       // поэтому поиск соответствующего байта является безопасным split-алгоритмом
@@ -191,6 +366,28 @@ private:
       }
     }
   } // method-end
+  // есть ли следующая часть корпуса
+  bool has_next_file() const
+  {
+    return !from_command && file_idx + 1 < files.size();
+  } // method-end
+  // переход к следующей части корпуса (пустая строка, возвращаемая read_line при переходе, завершает предложение)
+  void next_file()
+  {
+    FILE* next = fopen(files[file_idx + 1].c_str(), "rb");
+    if ( next == nullptr )
+    {
+      std::cerr << "ConllReader error: " << files[file_idx + 1] << ": " << std::strerror(errno) << std::endl;
+      files.resize(file_idx + 1); // остальные части не читаем (исчерпанный дескриптор завершит чтение)
+      return;
+    }
+    fclose( f );
+    f = next;
+    ++file_idx;
+    file_pos = 0;
+    idx_in_buf = BUF_SIZE;
+    real_buf_len = BUF_SIZE;
+  } // method-end
   // чтение предложения
   bool read_sentence_internal(SentenceMatrix& result)
   {
@@ -0,0 +1,324 @@
+#ifndef CORPUS_DEDUP_H_
+#define CORPUS_DEDUP_H_
+
+#include "conll_reader.h"
+#include "bounded_queue.h"
+#include "ostream_state_guard.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <limits>
+
+
+// Удаление дубликатов предложений из conll-корпуса (-task dedup).
+// Точные дубликаты определяются по 64-битному отпечатку последовательности словоформ, нечеткие (необязательно) --
+// по MinHash-сигнатуре множества шинглов из лемм с поиском кандидатов через LSH (сигнатура делится на полосы,
+// предложения с совпадающей полосой считаются дубликатами; порог сходства по Жаккару около (1/BANDS)^(1/ROWS) ~ 0.85).
+// Пара со сходством J признается дубликатом с вероятностью 1-(1-J^ROWS)^BANDS: ~0.5% при J=0.5, ~60% при J=0.85, ~88% при J=0.9.
+// Отпечатки вычисляются параллельно, а проверка и запись выполняются одним потоком в исходном порядке предложений,
+// поэтому результат детерминирован: сохраняется первое вхождение. Число пакетов в обработке ограничено (окно упорядочивания),
+// поэтому память не растет и при отставании одного из потоков. Отпечатки хранятся в хэш-таблицах фиксированного
+// размера (ограничение памяти); при заполнении таблицы новые отпечатки не запоминаются и часть дубликатов может быть пропущена.
+class CorpusDedup
+{
+private:
+  typedef ConllReader::SentenceMatrix SentenceMatrix;
+  static constexpr size_t MINHASH_BANDS = 5;
+  static constexpr size_t MINHASH_ROWS = 10;
+  static constexpr size_t SHINGLE_LEN = 3;
+  static constexpr size_t NEAR_MIN_TOKENS = 8;   // короткие предложения сравниваются только точно (мало шинглов -- много ложных совпадений)
+  static constexpr size_t BATCH_SIZE = 256;
+  static constexpr size_t WINDOW_BATCHES_PER_WORKER = 8; // окно упорядочивания: пакетов в обработке на один поток
+  // пакет предложений с вычисленными отпечатками
+  struct Batch
+  {
+    size_t seq = 0;
+    std::vector<SentenceMatrix> sentences;
+    std::vector<uint64_t> exact;
+    std::vector< std::array<uint64_t, MINHASH_BANDS> > bands;
+  };
+  // множество 64-битных отпечатков фиксированной емкости (открытая адресация, линейное пробирование)
+  class FingerprintSet
+  {
+  public:
+    FingerprintSet(uint64_t bytes)
+    {
+      size_t capacity = 1024;
+      while ( capacity * 2 * sizeof(uint64_t) <= bytes )
+        capacity *= 2;
+      slots.assign(capacity, 0);
+      max_fill = capacity / 10 * 9;
+    }
+    // false -- отпечаток уже встречался
+    bool insert(uint64_t fp)
+    {
+      if ( fp == 0 ) fp = 1; // 0 -- признак пустой ячейки
+      const size_t mask = slots.size() - 1;
+      for (size_t i = fp & mask; ; i = (i + 1) & mask)
+      {
+        if ( slots[i] == fp )
+          return false;
+        if ( slots[i] == 0 )
+        {
+          if ( fill >= max_fill )
+          {
+            ++overflow;
+            return true;
+          }
+          slots[i] = fp;
+          ++fill;
+          return true;
+        }
+      }
+    }
+    bool contains(uint64_t fp) const
+    {
+      if ( fp == 0 ) fp = 1;
+      const size_t mask = slots.size() - 1;
+      for (size_t i = fp & mask; slots[i] != 0; i = (i + 1) & mask)
+        if ( slots[i] == fp )
+          return true;
+      return false;
+    }
+    uint64_t get_overflow() const
+    {
+      return overflow;
+    }
+  private:
+    std::vector<uint64_t> slots;
+    size_t fill = 0;
+    size_t max_fill = 0;
+    uint64_t overflow = 0;
+  }; // class-decl-end: FingerprintSet
+public:
+  CorpusDedup(size_t threads_count, bool near_duplicates, size_t memory_mb)
+  : workers_count( std::max<size_t>(1, threads_count) )
+  , use_near(near_duplicates)
+  , memory_bytes( static_cast<uint64_t>(memory_mb) * 1024 * 1024 )
+  {
+  }
+  bool run(const std::string& input_fn, const std::string& output_fn)
+  {
+    ConllReader cr(input_fn);
+    if ( !cr.init() )
+    {
+      std::cerr << "Train-file open error: " << input_fn << std::endl;
+      return false;
+    }
+    std::ofstream ofs( output_fn.c_str(), std::ios::binary );
+    if ( !ofs.good() )
+    {
+      std::cerr << "Resulting-file open: error" << std::endl;
+      return false;
+    }
+    // память делится между таблицей точных отпечатков и таблицами полос
+    FingerprintSet exact_set( use_near ? memory_bytes / 2 : memory_bytes );
+    std::vector<FingerprintSet> band_sets;
+    if ( use_near )
+      for (size_t b = 0; b < MINHASH_BANDS; ++b)
+        band_sets.emplace_back( memory_bytes / 2 / MINHASH_BANDS );
+
+    BoundedQueue<Batch> raw_queue(workers_count * 4);
+    BoundedQueue<Batch> hashed_queue(workers_count * 4);
+    std::atomic<size_t> workers_running(workers_count);
+    // окно упорядочивания: читатель не выдает пакет, пока он опережает первый незаписанный пакет более чем на window
+    // (иначе при отставании одного потока все последующие пакеты накапливались бы в буфере упорядочивания)
+    const size_t window = workers_count * WINDOW_BATCHES_PER_WORKER;
+    size_t next_seq = 0;
+    std::mutex window_mtx;
+    std::condition_variable window_cv;
+    auto wait_window = [&](size_t seq)
+    {
+      std::unique_lock<std::mutex> lock(window_mtx);
+      window_cv.wait(lock, [&]() { return seq < next_seq + window; });
+    }; // func-end
+    // чтение
+    std::thread reader( [&]()
+    {
+      size_t seq = 0;
+      Batch batch;
+      SentenceMatrix sentence;
+      while ( cr.read_sentence(sentence) )
+      {
+        batch.sentences.push_back( std::move(sentence) );
+        if ( batch.sentences.size() == BATCH_SIZE )
+        {
+          wait_window(seq);
+          batch.seq = seq++;
+          raw_queue.push( std::move(batch) );
+          batch = Batch();
+        }
+      }
+      if ( !batch.sentences.empty() )
+      {
+        wait_window(seq);
+        batch.seq = seq++;
+        raw_queue.push( std::move(batch) );
+      }
+      cr.fin();
+      raw_queue.close();
+    } );
+    // вычисление отпечатков
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < workers_count; ++i)
+      workers.emplace_back( [&]()
+      {
+        Batch batch;
+        while ( raw_queue.pop(batch) )
+        {
+          fingerprint(batch);
+          hashed_queue.push( std::move(batch) );
+        }
+        if ( --workers_running == 0 )
+          hashed_queue.close();
+      } );
+    // проверка и запись в исходном порядке
+    std::map<size_t, Batch> pending;
+    Batch batch;
+    while ( hashed_queue.pop(batch) )
+    {
+      const size_t seq = batch.seq;
+      pending.emplace(seq, std::move(batch));
+      for (auto it = pending.find(next_seq); it != pending.end(); it = pending.find(next_seq))
+      {
+        filter_and_save(ofs, it->second, exact_set, band_sets);
+        pending.erase(it);
+        {
+          std::lock_guard<std::mutex> lock(window_mtx);
+          ++next_seq;
+        }
+        window_cv.notify_one();
+      }
+    }
+    reader.join();
+    for (auto& w : workers)
+      w.join();
+    // статистика
+    std::cout << std::endl;
+    std::cout << "Sentences read: " << sentences_read << ", kept: " << sentences_kept << std::endl;
+    std::cout << "  exact duplicates: " << exact_dups << std::endl;
+    if ( use_near )
+      std::cout << "  near duplicates: " << near_dups << std::endl;
+    std::cout << "Tokens read: " << tokens_read << ", kept: " << tokens_kept << std::endl;
+    if ( tokens_read > 0 )
+    {
+      OstreamStateGuard cout_state(std::cout);
+      std::cout << "Saved fraction (by tokens): " << std::fixed << std::setprecision(2)
+                << 100.0 * (tokens_read - tokens_kept) / tokens_read << "%" << std::endl;
+    }
+    uint64_t overflow = exact_set.get_overflow();
+    for (auto& bs : band_sets)
+      overflow += bs.get_overflow();
+    if ( overflow > 0 )
+      std::cout << "Warning: fingerprint tables are full (" << overflow << " fingerprints not stored), increase -dedup_mem" << std::endl;
+    return true;
+  } // method-end
+private:
+  size_t workers_count;
+  bool use_near;
+  uint64_t memory_bytes;
+  uint64_t sentences_read = 0, sentences_kept = 0, exact_dups = 0, near_dups = 0;
+  uint64_t tokens_read = 0, tokens_kept = 0;
+
+  // FNV-1a с последующим перемешиванием (splitmix64)
+  static inline uint64_t mix(uint64_t x)
+  {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+  } // method-end
+  static inline uint64_t fnv(const std::string& s, uint64_t h = 0xCBF29CE484222325ULL)
+  {
+    for (unsigned char c : s)
+      h = (h ^ c) * 0x100000001B3ULL;
+    return h;
+  } // method-end
+  void fingerprint(Batch& batch) const
+  {
+    const size_t n = batch.sentences.size();
+    batch.exact.resize(n);
+    if ( use_near )
+      batch.bands.resize(n);
+    std::array<uint64_t, MINHASH_BANDS * MINHASH_ROWS> signature;
+    for (size_t s = 0; s < n; ++s)
+    {
+      auto& sm = batch.sentences[s];
+      uint64_t h = 0xCBF29CE484222325ULL;
+      for (auto& token : sm)
+        h = fnv(token[Conll::FORM], h) * 0x100000001B3ULL; // разделитель токенов
+      batch.exact[s] = mix(h);
+      if ( !use_near || sm.size() < NEAR_MIN_TOKENS )
+        continue;
+      // MinHash по шинглам из лемм
+      signature.fill( std::numeric_limits<uint64_t>::max() );
+      for (size_t i = 0; i + SHINGLE_LEN <= sm.size(); ++i)
+      {
+        uint64_t sh = 0xCBF29CE484222325ULL;
+        for (size_t j = i; j < i + SHINGLE_LEN; ++j)
+          sh = fnv(sm[j][Conll::LEMMA], sh) * 0x100000001B3ULL;
+        for (size_t k = 0; k < signature.size(); ++k)
+          signature[k] = std::min(signature[k], mix(sh ^ mix(k + 1)));
+      }
+      for (size_t b = 0; b < MINHASH_BANDS; ++b)
+      {
+        uint64_t bh = b;
+        for (size_t r = 0; r < MINHASH_ROWS; ++r)
+          bh = mix(bh ^ signature[b * MINHASH_ROWS + r]);
+        batch.bands[s][b] = bh;
+      }
+    }
+  } // method-end
+  void filter_and_save(std::ofstream& ofs, const Batch& batch, FingerprintSet& exact_set, std::vector<FingerprintSet>& band_sets)
+  {
+    for (size_t s = 0; s < batch.sentences.size(); ++s)
+    {
+      auto& sm = batch.sentences[s];
+      ++sentences_read;
+      tokens_read += sm.size();
+      if ( !exact_set.insert(batch.exact[s]) )
+      {
+        ++exact_dups;
+        continue;
+      }
+      if ( use_near && sm.size() >= NEAR_MIN_TOKENS )
+      {
+        bool near = false;
+        for (size_t b = 0; b < MINHASH_BANDS && !near; ++b)
+          near = band_sets[b].contains(batch.bands[s][b]);
+        if ( near )
+        {
+          ++near_dups;
+          continue;
+        }
+        for (size_t b = 0; b < MINHASH_BANDS; ++b)
+          band_sets[b].insert(batch.bands[s][b]);
+      }
+      ++sentences_kept;
+      tokens_kept += sm.size();
+      save_sentence(ofs, sm);
+    }
+  } // method-end
+  void save_sentence(std::ofstream& ofs, const SentenceMatrix& data)
+  {
+    for (auto& t : data)
+    {
+      ofs << t[0] << '\t' << t[1] << '\t' << t[2] << '\t' << t[3] << '\t' << t[4] << '\t'
+          << t[5] << '\t' << t[6] << '\t' << t[7] << '\t' << t[8] << '\t' << t[9] << '\n';
+    }
+    ofs << '\n';
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* CORPUS_DEDUP_H_ */
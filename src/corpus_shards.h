@@ -0,0 +1,118 @@
+#ifndef CORPUS_SHARDS_H_
+#define CORPUS_SHARDS_H_
+
+#include "str_conv.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+
+// Раскрытие спецификации корпуса, разбитого на части (шарды), в список файлов.
+// Спецификация может задавать:
+//   - один файл: corpus.conll
+//   - каталог (все файлы каталога, кроме скрытых, без вложенных): corpus_dir
+//   - шаблон имени файла (символы * и ? допустимы только в имени, не в пути к каталогу): corpus_dir/part-*.conll
+//   - манифест (список файлов, по одному в строке; относительные пути отсчитываются от каталога манифеста): @corpus.list
+// Файлы каталога и шаблона упорядочиваются по имени, файлы манифеста -- в порядке перечисления.
+class CorpusShards
+{
+public:
+  static bool resolve(const std::string& spec, std::vector<std::string>& files)
+  {
+    namespace fs = std::filesystem;
+    files.clear();
+    std::error_code ec;
+    if ( !spec.empty() && spec[0] == '@' )
+    {
+      if ( !load_manifest(spec.substr(1), files) )
+        return false;
+    }
+    else if ( fs::is_directory(spec, ec) )
+    {
+      for (auto& entry : fs::directory_iterator(spec, ec))
+        if ( entry.is_regular_file(ec) && entry.path().filename().string()[0] != '.' )
+          files.push_back( entry.path().string() );
+      std::sort(files.begin(), files.end());
+    }
+    else if ( spec.find_first_of("*?") != std::string::npos )
+    {
+      const fs::path spec_path(spec);
+      const std::string pattern = spec_path.filename().string();
+      const fs::path dir = spec_path.has_parent_path() ? spec_path.parent_path() : fs::path(".");
+      if ( dir.string().find_first_of("*?") != std::string::npos )
+      {
+        std::cerr << "Wildcards are allowed in file names only: " << spec << std::endl;
+        return false;
+      }
+      for (auto& entry : fs::directory_iterator(dir, ec))
+        if ( entry.is_regular_file(ec) && wildcard_match(pattern, entry.path().filename().string()) )
+          files.push_back( entry.path().string() );
+      std::sort(files.begin(), files.end());
+    }
+    else
+      files.push_back(spec);
+    if ( files.empty() )
+    {
+      std::cerr << "No corpus files found for: " << spec << std::endl;
+      return false;
+    }
+    return true;
+  } // method-end
+private:
+  static bool load_manifest(const std::string& manifest_fn, std::vector<std::string>& files)
+  {
+    namespace fs = std::filesystem;
+    std::ifstream ifs(manifest_fn);
+    if ( !ifs.good() )
+    {
+      std::cerr << "Can't open corpus manifest: " << manifest_fn << std::endl;
+      return false;
+    }
+    const fs::path base = fs::path(manifest_fn).parent_path();
+    std::string line;
+    while ( std::getline(ifs, line) )
+    {
+      StrConv::trim(line);
+      if ( line.empty() || line[0] == '#' )
+        continue;
+      fs::path p(line);
+      files.push_back( (p.is_relative() && !base.empty()) ? (base / p).string() : line );
+    }
+    return true;
+  } // method-end
+  // сопоставление имени с шаблоном (* -- любая последовательность символов, ? -- любой один байт)
+  static bool wildcard_match(const std::string& pattern, const std::string& name)
+  {
+    size_t p = 0, n = 0, star = std::string::npos, star_n = 0;
+    while ( n < name.size() )
+    {
+      if ( p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]) )
+      {
+        ++p;
+        ++n;
+      }
+      else if ( p < pattern.size() && pattern[p] == '*' )
+      {
+        star = p++;
+        star_n = n;
+      }
+      else if ( star != std::string::npos )
+      {
+        p = star + 1;
+        n = ++star_n;
+      }
+      else
+        return false;
+    }
+    while ( p < pattern.size() && pattern[p] == '*' )
+      ++p;
+    return p == pattern.size();
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* CORPUS_SHARDS_H_ */
@@ -0,0 +1,51 @@
+#ifndef COUNTER_RNG_H_
+#define COUNTER_RNG_H_
+
+#include <cstdint>
+#include <cstddef>
+
+
+// Генератор псевдослучайных чисел на основе счетчика (Philox4x32-10, Salmon et al., 2011).
+// Значение определяется только ключом и счетчиком (например, номером строки и измерения матрицы), а не историей вызовов,
+// поэтому матрицу можно заполнять параллельно в любом порядке -- результат не зависит от количества потоков.
+class CounterRng
+{
+public:
+  // четыре 32-битных псевдослучайных слова для счетчика (ctr_hi, ctr_lo) и ключа key
+  static inline void philox(uint64_t key, uint64_t ctr_hi, uint64_t ctr_lo, uint32_t out[4])
+  {
+    const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+    uint32_t c0 = static_cast<uint32_t>(ctr_lo), c1 = static_cast<uint32_t>(ctr_lo >> 32);
+    uint32_t c2 = static_cast<uint32_t>(ctr_hi), c3 = static_cast<uint32_t>(ctr_hi >> 32);
+    uint32_t k0 = static_cast<uint32_t>(key), k1 = static_cast<uint32_t>(key >> 32);
+    for (size_t round = 0; round < 10; ++round)
+    {
+      const uint64_t p0 = static_cast<uint64_t>(M0) * c0;
+      const uint64_t p1 = static_cast<uint64_t>(M1) * c2;
+      const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c1 = static_cast<uint32_t>(p1);
+      c3 = static_cast<uint32_t>(p0);
+      c0 = n0;
+      c2 = n2;
+      k0 += W0;
+      k1 += W1;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+  } // method-end
+  // заполнение строки row равномерно распределенными на [0, 1) величинами (24 значащих бита)
+  static void uniform_row(uint64_t key, uint64_t row, float* dst, size_t n)
+  {
+    uint32_t r[4];
+    for (size_t b = 0; b < n; b += 4)
+    {
+      philox(key, row, b / 4, r);
+      for (size_t i = 0; i < 4 && b + i < n; ++i)
+        dst[b + i] = (r[i] >> 8) * (1.0f / 16777216.0f);
+    }
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* COUNTER_RNG_H_ */
@@ -0,0 +1,454 @@
+#ifndef DISTRIBUTED_SYNC_H_
+#define DISTRIBUTED_SYNC_H_
+
+#include <string>
+#include <vector>
+#include <cstring>       // for std::strerror, std::memcpy
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <iostream>
+
+#ifndef _MSC_VER
+  #include <sys/types.h>
+  #include <sys/socket.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <netdb.h>
+  #include <unistd.h>
+#endif
+
+
+// Синхронизация весовых матриц между несколькими процессами (узлами), обучающими одну модель на разных частях корпуса.
+// Топология "звезда": узел 0 (ведущий) принимает подключения остальных узлов, собирает от них изменения,
+// усредняет их и рассылает результат (аналог allreduce). После каждого раунда матрицы всех узлов совпадают, поэтому
+// снимки матриц не хранятся: обучение отмечает изменяемые строки (признаки изменения выдает attach), узлы передают
+// текущие значения только отмеченных строк, а ведущий узел усредняет их по узлам, изменившим строку (это равносильно
+// прибавлению к общему состоянию средней разности). Матрицы целиком не копируются и не просматриваются.
+// Синхронизация выполняется раундами, в каждом раунде участвуют все узлы (узел, завершивший обучение,
+// продолжает участвовать в раундах с пустыми изменениями, пока обучение не завершат все).
+// Предполагается однородный кластер (одинаковый порядок байт и представление float на всех узлах).
+class DistributedSync
+{
+public:
+  // сведения, передаваемые узлом в раунде синхронизации
+  struct RoundInfo
+  {
+    uint64_t words = 0;     // количество слов, обработанных узлом с момента предыдущей синхронизации
+    uint64_t dep_se = 0;    // счетчики насыщения сигмоиды (для принятия согласованного решения о масштабировании пространства)
+    uint64_t ass_se = 0;
+    bool finished = false;  // узел завершил обучение
+  };
+  // результат раунда синхронизации (одинаков для всех узлов)
+  struct RoundResult
+  {
+    uint64_t global_words = 0;   // суммарное количество слов, обработанных всеми узлами
+    bool rescale_dep = false;
+    bool rescale_assoc = false;
+    bool all_finished = false;
+  };
+public:
+  DistributedSync(size_t nodesCount, size_t nodeRank, const std::string& masterAddress, uint64_t syncWords)
+  : nodes_count(nodesCount)
+  , rank(nodeRank)
+  , master_address(masterAddress)
+  , sync_words(syncWords)
+  {
+  }
+  ~DistributedSync()
+  {
+#ifndef _MSC_VER
+    for (auto s : sockets)
+      if (s >= 0)
+        close(s);
+#endif
+  }
+  // поддерживается ли распределенное обучение на данной платформе
+  static bool is_supported()
+  {
+#ifndef _MSC_VER
+    return true;
+#else
+    return false;
+#endif
+  }
+  size_t get_rank() const { return rank; }
+  size_t get_nodes_count() const { return nodes_count; }
+  uint64_t get_sync_words() const { return sync_words; }
+  bool is_master() const { return rank == 0; }
+  // установление соединений (ведущий узел ожидает подключения всех остальных)
+  bool connect()
+  {
+#ifndef _MSC_VER
+    auto colon_pos = master_address.rfind(':');
+    if ( colon_pos == std::string::npos )
+    {
+      std::cerr << "DistributedSync: master address must be <host>:<port>" << std::endl;
+      return false;
+    }
+    const std::string host = master_address.substr(0, colon_pos);
+    const std::string port = master_address.substr(colon_pos + 1);
+    if ( is_master() )
+      return accept_nodes(port);
+    else
+      return connect_to_master(host, port);
+#else
+    std::cerr << "DistributedSync: distributed training is not supported on this platform" << std::endl;
+    return false;
+#endif
+  } // method-end
+  // регистрация синхронизируемой матрицы (до вызова start); возвращает признаки изменения строк, которые обучение
+  // должно выставлять (в 1) для каждой изменяемой строки между раундами синхронизации
+  uint8_t* attach(float* data, size_t rows, size_t cols)
+  {
+    matrices.push_back( {data, rows, cols, std::vector<uint8_t>(rows, 0), std::vector<uint16_t>()} );
+    return matrices.back().touched.data();
+  } // method-end
+  // начальная синхронизация: ведущий узел раздает свои матрицы остальным узлам (обучение стартует из одной точки)
+  bool start()
+  {
+    if ( is_master() )
+    {
+      for (size_t n = 1; n < nodes_count; ++n)
+      {
+        for (auto& m : matrices)
+        {
+          uint64_t dims[2];
+          if ( !recv_all(sockets[n], dims, sizeof(dims)) ) return false;
+          if ( dims[0] != m.rows || dims[1] != m.cols )
+          {
+            std::cerr << "DistributedSync: node " << n << " has different matrix dimensions (vocabularies or sizes differ)" << std::endl;
+            return false;
+          }
+        }
+        for (auto& m : matrices)
+          if ( !send_all(sockets[n], m.data, m.rows * m.cols * sizeof(float)) ) return false;
+      }
+    }
+    else
+    {
+      for (auto& m : matrices)
+      {
+        uint64_t dims[2] = {m.rows, m.cols};
+        if ( !send_all(sockets[0], dims, sizeof(dims)) ) return false;
+      }
+      for (auto& m : matrices)
+        if ( !recv_all(sockets[0], m.data, m.rows * m.cols * sizeof(float)) ) return false;
+    }
+    for (auto& m : matrices)
+    {
+      std::fill(m.touched.begin(), m.touched.end(), 0);
+      if ( is_master() )
+        m.counts.assign(m.rows, 0);
+    }
+    return true;
+  } // method-end
+  // раунд синхронизации; вызывается, когда локальные потоки обучения приостановлены
+  bool round(const RoundInfo& local, RoundResult& result)
+  {
+    bool ok = is_master() ? master_round(local, result) : node_round(local, result);
+    if ( !ok )
+      std::cerr << "DistributedSync: synchronization round failed" << std::endl;
+    return ok;
+  } // method-end
+private:
+  struct Matrix
+  {
+    float* data;
+    size_t rows;
+    size_t cols;
+    std::vector<uint8_t> touched;  // признаки строк, измененных узлом с момента последней синхронизации
+    std::vector<uint16_t> counts;  // (ведущий узел) количество узлов, изменивших строку в текущем раунде
+  };
+  // заголовок сообщения узла и ответа ведущего узла
+  struct NodeHeader
+  {
+    uint64_t words;
+    uint64_t dep_se;
+    uint64_t ass_se;
+    uint64_t finished;
+  };
+  struct MasterHeader
+  {
+    uint64_t global_words;
+    uint64_t flags;
+  };
+  enum MasterFlags { mfRescaleDep = 1, mfRescaleAssoc = 2, mfAllFinished = 4 };
+  // пороговое значение суммарного счетчика насыщения, при котором все узлы масштабируют пространство
+  static constexpr uint64_t SE_THRESHOLD = 1000000;
+
+  size_t nodes_count;
+  size_t rank;
+  std::string master_address;
+  uint64_t sync_words;
+  // сокеты: у ведущего узла -- соединения с узлами (индекс = номер узла, нулевой не используется), у остальных -- единственное соединение с ведущим
+  std::vector<int> sockets;
+  std::vector<Matrix> matrices;
+  // (ведущий узел) суммарное количество обработанных слов
+  uint64_t total_words = 0;
+
+  bool node_round(const RoundInfo& local, RoundResult& result)
+  {
+    NodeHeader nh { local.words, local.dep_se, local.ass_se, local.finished ? 1ULL : 0ULL };
+    if ( !send_all(sockets[0], &nh, sizeof(nh)) ) return false;
+    // отправляем текущие значения изменившихся строк
+    std::vector<char> buf;
+    for (auto& m : matrices)
+    {
+      collect_rows(m, m.touched, buf);
+      if ( !send_all(sockets[0], buf.data(), buf.size()) ) return false;
+      std::fill(m.touched.begin(), m.touched.end(), 0);
+    }
+    // получаем результат усреднения
+    MasterHeader mh;
+    if ( !recv_all(sockets[0], &mh, sizeof(mh)) ) return false;
+    for (auto& m : matrices)
+    {
+      if ( !recv_rows(sockets[0], m, buf) ) return false;
+      const size_t row_bytes = sizeof(uint32_t) + m.cols * sizeof(float);
+      for (const char* p = buf.data(), *pEnd = buf.data() + buf.size(); p < pEnd; p += row_bytes)
+      {
+        uint32_t r;
+        std::memcpy(&r, p, sizeof(r));
+        std::memcpy(m.data + r * m.cols, p + sizeof(r), m.cols * sizeof(float));
+      }
+    }
+    fill_result(mh, result);
+    return true;
+  } // method-end
+  bool master_round(const RoundInfo& local, RoundResult& result)
+  {
+    uint64_t dep_se = local.dep_se, ass_se = local.ass_se;
+    bool all_finished = local.finished;
+    total_words += local.words;
+    // собственные изменения ведущего узла уже находятся в матрицах
+    for (auto& m : matrices)
+    {
+      std::copy(m.touched.begin(), m.touched.end(), m.counts.begin());
+      std::fill(m.touched.begin(), m.touched.end(), 0);
+    }
+    // накапливаем в матрицах суммы значений строк, измененных узлами (строка, не измененная ведущим узлом,
+    // содержит общее состояние и заменяется значением первого изменившего ее узла)
+    std::vector<char> buf;
+    for (size_t n = 1; n < nodes_count; ++n)
+    {
+      NodeHeader nh;
+      if ( !recv_all(sockets[n], &nh, sizeof(nh)) ) return false;
+      total_words += nh.words;
+      dep_se += nh.dep_se;
+      ass_se += nh.ass_se;
+      all_finished = all_finished && (nh.finished != 0);
+      for (auto& m : matrices)
+      {
+        if ( !recv_rows(sockets[n], m, buf) ) return false;
+        const size_t row_bytes = sizeof(uint32_t) + m.cols * sizeof(float);
+        for (const char* p = buf.data(), *pEnd = buf.data() + buf.size(); p < pEnd; p += row_bytes)
+        {
+          uint32_t r;
+          std::memcpy(&r, p, sizeof(r));
+          float* row = m.data + r * m.cols;
+          if ( m.counts[r] == 0 )
+            std::memcpy(row, p + sizeof(r), m.cols * sizeof(float));
+          else
+          {
+            const float* value = reinterpret_cast<const float*>(p + sizeof(r));
+            for (size_t c = 0; c < m.cols; ++c)
+            {
+              float v;
+              std::memcpy(&v, value + c, sizeof(v));
+              row[c] += v;
+            }
+          }
+          ++m.counts[r];
+        }
+      }
+    }
+    // усреднение по узлам, изменившим строку (равносильно прибавлению к общему состоянию средней разности;
+    // деление на общее число узлов размывало бы обновления редких слов, встретившихся лишь в части корпуса)
+    for (auto& m : matrices)
+      for (size_t r = 0; r < m.rows; ++r)
+      {
+        if ( m.counts[r] < 2 ) continue;
+        float* row = m.data + r * m.cols;
+        const float inv = 1.0f / m.counts[r];
+        for (size_t c = 0; c < m.cols; ++c)
+          row[c] *= inv;
+      }
+    // рассылка результата
+    MasterHeader mh { total_words, 0 };
+    if ( dep_se >= SE_THRESHOLD ) mh.flags |= mfRescaleDep;
+    if ( ass_se >= SE_THRESHOLD ) mh.flags |= mfRescaleAssoc;
+    if ( all_finished ) mh.flags |= mfAllFinished;
+    for (size_t n = 1; n < nodes_count; ++n)
+      if ( !send_all(sockets[n], &mh, sizeof(mh)) ) return false;
+    for (auto& m : matrices)
+    {
+      collect_rows(m, m.counts, buf);
+      for (size_t n = 1; n < nodes_count; ++n)
+        if ( !send_all(sockets[n], buf.data(), buf.size()) ) return false;
+    }
+    fill_result(mh, result);
+    return true;
+  } // method-end
+  static void fill_result(const MasterHeader& mh, RoundResult& result)
+  {
+    result.global_words = mh.global_words;
+    result.rescale_dep = (mh.flags & mfRescaleDep) != 0;
+    result.rescale_assoc = (mh.flags & mfRescaleAssoc) != 0;
+    result.all_finished = (mh.flags & mfAllFinished) != 0;
+  } // method-end
+  // сериализация значений отмеченных строк (marks[r] != 0): количество строк, затем (номер строки, значения)
+  template <typename Mark>
+  void collect_rows(const Matrix& m, const std::vector<Mark>& marks, std::vector<char>& buf) const
+  {
+    const size_t row_bytes = sizeof(uint32_t) + m.cols * sizeof(float);
+    buf.resize(sizeof(uint64_t));
+    uint64_t cnt = 0;
+    for (size_t r = 0; r < m.rows; ++r)
+    {
+      if ( marks[r] == 0 ) continue;
+      const float* row = m.data + r * m.cols;
+      const uint32_t r32 = r;
+      const size_t offset = buf.size();
+      buf.resize(offset + row_bytes);
+      std::memcpy(buf.data() + offset, &r32, sizeof(r32));
+      std::memcpy(buf.data() + offset + sizeof(r32), row, m.cols * sizeof(float));
+      ++cnt;
+    }
+    std::memcpy(buf.data(), &cnt, sizeof(cnt));
+  } // method-end
+  // чтение сериализованных строк (без счетчика) в буфер
+  bool recv_rows(int s, const Matrix& m, std::vector<char>& buf)
+  {
+    uint64_t cnt = 0;
+    if ( !recv_all(s, &cnt, sizeof(cnt)) ) return false;
+    if ( cnt > m.rows )
+    {
+      std::cerr << "DistributedSync: protocol error" << std::endl;
+      return false;
+    }
+    buf.resize( cnt * (sizeof(uint32_t) + m.cols * sizeof(float)) );
+    return recv_all(s, buf.data(), buf.size());
+  } // method-end
+#ifndef _MSC_VER
+  bool accept_nodes(const std::string& port)
+  {
+    int ls = socket(AF_INET, SOCK_STREAM, 0);
+    if (ls < 0) return net_error("socket");
+    int yes = 1;
+    setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons( std::stoi(port) );
+    if ( bind(ls, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(ls, nodes_count) != 0 )
+    {
+      net_error("bind/listen");
+      close(ls);
+      return false;
+    }
+    std::cout << "Waiting for " << (nodes_count - 1) << " node(s) on port " << port << std::endl;
+    sockets.assign(nodes_count, -1);
+    for (size_t i = 1; i < nodes_count; ++i)
+    {
+      int s = accept(ls, nullptr, nullptr);
+      if (s < 0) { net_error("accept"); close(ls); return false; }
+      uint64_t node_rank = 0;
+      if ( !recv_all(s, &node_rank, sizeof(node_rank)) || node_rank == 0 || node_rank >= nodes_count || sockets[node_rank] >= 0 )
+      {
+        std::cerr << "DistributedSync: invalid node rank on connection" << std::endl;
+        close(s); close(ls);
+        return false;
+      }
+      set_nodelay(s);
+      sockets[node_rank] = s;
+      std::cout << "  node " << node_rank << " connected" << std::endl;
+    }
+    close(ls);
+    return true;
+  } // method-end
+  bool connect_to_master(const std::string& host, const std::string& port)
+  {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* ai = nullptr;
+    if ( getaddrinfo(host.c_str(), port.c_str(), &hints, &ai) != 0 || ai == nullptr )
+    {
+      std::cerr << "DistributedSync: can't resolve master address " << master_address << std::endl;
+      return false;
+    }
+    // ведущий узел может быть запущен позже, поэтому повторяем попытки подключения
+    const size_t CONNECT_ATTEMPTS = 120;
+    int s = -1;
+    for (size_t attempt = 0; attempt < CONNECT_ATTEMPTS && s < 0; ++attempt)
+    {
+      s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (s >= 0 && ::connect(s, ai->ai_addr, ai->ai_addrlen) != 0)
+      {
+        close(s);
+        s = -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+      }
+    }
+    freeaddrinfo(ai);
+    if (s < 0) return net_error("connect");
+    set_nodelay(s);
+    uint64_t node_rank = rank;
+    if ( !send_all(s, &node_rank, sizeof(node_rank)) ) { close(s); return false; }
+    sockets.assign(1, s);
+    std::cout << "Connected to master " << master_address << std::endl;
+    return true;
+  } // method-end
+  static void set_nodelay(int s)
+  {
+    int yes = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  } // method-end
+  static bool net_error(const char* what)
+  {
+    std::cerr << "DistributedSync: " << what << " error: " << std::strerror(errno) << std::endl;
+    return false;
+  } // method-end
+#endif
+  static bool send_all(int s, const void* data, size_t len)
+  {
+#ifndef _MSC_VER
+    const char* p = reinterpret_cast<const char*>(data);
+    while (len > 0)
+    {
+      ssize_t n = send(s, p, len, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return net_error("send");
+      p += n; len -= n;
+    }
+    return true;
+#else
+    return false;
+#endif
+  } // method-end
+  static bool recv_all(int s, void* data, size_t len)
+  {
+#ifndef _MSC_VER
+    char* p = reinterpret_cast<char*>(data);
+    while (len > 0)
+    {
+      ssize_t n = recv(s, p, len, 0);
+      if (n < 0 && errno == EINTR) continue;
+      if (n == 0) { std::cerr << "DistributedSync: connection closed by peer" << std::endl; return false; }
+      if (n < 0) return net_error("recv");
+      p += n; len -= n;
+    }
+    return true;
+#else
+    return false;
+#endif
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* DISTRIBUTED_SYNC_H_ */
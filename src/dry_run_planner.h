@@ -0,0 +1,300 @@
+#ifndef DRY_RUN_PLANNER_H_
+#define DRY_RUN_PLANNER_H_
+
+#include "command_line_parameters_defs.h"
+#include "vocabulary.h"
+#include "learning_example.h"
+#include "trainer.h"
+#include "conll_reader.h"
+#include "ostream_state_guard.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <thread>
+
+#ifndef _MSC_VER
+  #include <unistd.h>
+#endif
+
+
+// Планировщик обучения (режим -dry_run): до загрузки словарей и выделения весовых матриц оценивает потребность в памяти
+// и (по короткому калибровочному прогону skip_gram на синтетических примерах) ожидаемую скорость и длительность обучения
+class DryRunPlanner
+{
+public:
+  static bool run(const CommandLineParametersDefs& cmdLineParams, const std::vector<CommandLineParametersDefs>& configs)
+  {
+    const size_t threads_count = cmdLineParams.getAsInt("-threads");
+    // словари просматриваются потоково (без построения хэш-отображений): нужны только размеры, частоты и длины слов
+    VocabSummary words, deps;
+    if ( !scan_vocab(cmdLineParams.getAsString("-vocab_l"), words) )
+      return false;
+    bool need_deps = false, need_assoc = false;
+    for (auto& cfg : configs)
+    {
+      need_deps = need_deps || (cfg.getAsInt("-size_d") > 0);
+      need_assoc = need_assoc || (cfg.getAsInt("-size_a") > 0);
+    }
+    if ( need_deps && !scan_vocab(cmdLineParams.getAsString("-vocab_d"), deps) )
+      return false;
+
+    std::cout << "Dry run: lemmas vocabulary " << words.size() << " records (" << words.cn_sum << " words)";
+    if ( need_deps )
+      std::cout << ", dependency contexts vocabulary " << deps.size() << " records";
+    std::cout << std::endl << std::endl;
+
+    // оценка памяти
+    uint64_t total = 0;
+    total += print_item("lemmas vocabulary", vocab_bytes(words));
+    if ( need_deps )
+      total += print_item("dependency contexts vocabulary", vocab_bytes(deps));
+    if ( need_assoc )
+      total += print_item("associative contexts vocabulary", vocab_bytes(words));
+    for (size_t i = 0; i < configs.size(); ++i)
+    {
+      auto& cfg = configs[i];
+      const uint64_t size_d = cfg.getAsInt("-size_d");
+      const uint64_t size_a = cfg.getAsInt("-size_a");
+      const std::string sfx = (configs.size() > 1) ? " [" + std::to_string(i) + "]" : "";
+      const uint64_t syn0 = words.size() * (size_d + size_a) * sizeof(float);
+      // при иерархическом softmax строки syn1_dep -- внутренние узлы дерева Хаффмана (их на один меньше, чем контекстов)
+      const bool hs = ( cfg.getAsString("-objective_d") == "hs" );
+      const uint64_t dep_rows = (size_d > 0) ? (hs ? std::max<uint64_t>(1, deps.size() - 1) : deps.size()) : 0;
+      const uint64_t syn1_dep = dep_rows * size_d * sizeof(float);
+      total += print_item("syn0" + sfx, syn0);
+      if ( size_d > 0 )
+      {
+        total += print_item("syn1_dep" + sfx, syn1_dep);
+        if ( hs )
+        {
+          // смещения путей и верхняя оценка суммарной длины путей (V * ceil(log2 V)) по 5 байт на узел пути
+          const uint64_t path_len = std::max<uint64_t>(1, std::ceil(std::log2(std::max<uint64_t>(2, deps.size()))));
+          total += print_item("Huffman tree" + sfx, (deps.size() + 1) * sizeof(uint64_t) + deps.size() * path_len * (sizeof(uint32_t) + sizeof(uint8_t)));
+        }
+        else
+          total += print_item("noise table" + sfx, NOISE_TABLE_BYTES);
+      }
+      if ( cfg.getAsInt("-adagrad") == 1 )
+        total += print_item("adagrad accumulators" + sfx, (words.size() * 2 + dep_rows) * sizeof(float));
+      // распределенная синхронизация: признак изменения строки (1 байт), на ведущем узле -- еще и счетчик узлов (2 байта)
+      if ( cmdLineParams.getAsInt("-dist_nodes") > 1 )
+      {
+        const uint64_t rows = words.size() + dep_rows;
+        const uint64_t per_row = sizeof(uint8_t) + ( (cmdLineParams.getAsInt("-dist_rank") == 0) ? sizeof(uint16_t) : 0 );
+        total += print_item("distributed sync row flags" + sfx, rows * per_row);
+      }
+      // буфер ошибки, буферы предложения и пакета отрицательных примеров
+      const uint64_t per_thread = (size_d + size_a) * sizeof(float)
+                                  + SENTENCE_RESERVE * ( sizeof(LearningExample) + sizeof(std::vector<std::string>) )
+                                  + (cfg.getAsInt("-negative_d") + 1) * (sizeof(size_t) + sizeof(float));
+      total += print_item("per-thread buffers (x" + std::to_string(threads_count) + ")" + sfx, per_thread * threads_count);
+    }
+    std::cout << "  " << std::left << std::setw(ITEM_WIDTH) << "TOTAL" << human(total) << std::endl;
+    const uint64_t phys = physical_memory();
+    if ( phys )
+    {
+      std::cout << "  " << std::left << std::setw(ITEM_WIDTH) << "physical memory" << human(phys) << std::endl;
+      if ( total > phys )
+        std::cout << "  WARNING: projected memory exceeds physical memory (consider -mmap_net)" << std::endl;
+    }
+    std::cout << std::endl;
+
+    // калибровочный прогон: доля слов, становящихся обучающими примерами, оценивается по частотам словаря с учетом сабсэмплинга
+    const double keep = kept_fraction(words, cmdLineParams.getAsFloat("-sample_w"));
+    double seconds_per_example = 0;
+    uint64_t total_words = 0;
+    for (size_t i = 0; i < configs.size(); ++i)
+    {
+      auto& cfg = configs[i];
+      const double eps = calibrate(cmdLineParams, cfg, words, deps, threads_count);
+      OstreamStateGuard cout_state(std::cout);
+      std::cout << "Calibration" << ((configs.size() > 1) ? " [" + std::to_string(i) + "]" : "")
+                << ": " << std::fixed << std::setprecision(2) << eps / 1000 << "k examples/sec" << std::endl;
+      // модели группы обучаются на одних и тех же примерах последовательно
+      seconds_per_example += 1.0 / eps;
+      total_words = std::max<uint64_t>(total_words, words.cn_sum * cfg.getAsInt("-iter"));
+    }
+    // каждый поток сам читает свою часть корпуса: время на слово складывается из разбора строки и обучения на оставшихся примерах
+    // (чтение распараллеливается не более чем на количество ядер; калибровочная скорость обучения уже учитывает все потоки)
+    // (потоковый корпус читается одним потоком-читателем параллельно с обучением и здесь не оценивается)
+    const bool streaming = cmdLineParams.isDefined("-train_cmd") || cmdLineParams.getAsString("-train") == "stdin";
+    const double read_wps = streaming ? 0 : calibrate_reading( cmdLineParams.getAsString("-train") );
+    const size_t cores = std::max<size_t>(1, std::min<size_t>(threads_count, std::thread::hardware_concurrency()));
+    const double seconds_per_word = (read_wps > 0 ? 1.0 / (read_wps * cores) : 0) + keep * seconds_per_example;
+    const double words_per_sec = 1.0 / seconds_per_word;
+    OstreamStateGuard cout_state(std::cout);
+    std::cout << std::fixed;
+    std::cout << "Assumed contexts per example: " << DEP_CTX_PER_WORD << " dependency, " << ASSOC_CTX_PER_WORD << " associative" << std::endl;
+    std::cout << "Kept words fraction (subsampling): " << std::setprecision(3) << keep << std::endl;
+    if ( read_wps > 0 )
+      std::cout << "Corpus reading (one thread): " << std::setprecision(2) << read_wps / 1000 << "k words/sec" << std::endl;
+    std::cout << "Projected speed: " << std::setprecision(2) << words_per_sec / 1000 << "k words/sec" << std::endl;
+    std::cout << "Projected training time: " << std::setprecision(0) << total_words / words_per_sec << " seconds ("
+              << total_words << " words, " << threads_count << " threads)" << std::endl;
+    return true;
+  } // method-end
+private:
+  static constexpr size_t ITEM_WIDTH = 44;
+  static constexpr uint64_t NOISE_TABLE_BYTES = 1e8 * sizeof(int);
+  static constexpr size_t SENTENCE_RESERVE = 1000;         // резервируемая длина предложения в ThreadEnvironment
+  static constexpr size_t VOCAB_HASH_RESERVE = 21000000;   // резервируемый размер хэш-отображения OriginalWord2VecVocabulary
+  static constexpr size_t CALIBRATION_ROWS = 200000;       // размер синтетических словарей калибровочного прогона
+  static constexpr size_t CALIBRATION_NOISE_TABLE = 1e6;
+  static constexpr double CALIBRATION_SECONDS = 3.0;
+  static constexpr double READING_CALIBRATION_SECONDS = 1.0;
+  static constexpr size_t DEP_CTX_PER_WORD = 2;            // в дереве зависимостей у слова в среднем одна вершина и один зависимый
+  static constexpr size_t ASSOC_CTX_PER_WORD = 5;          // ассоциативные контексты после сабсэмплинга
+
+  // сводные сведения о словаре (частоты в порядке следования записей)
+  struct VocabSummary
+  {
+    std::vector<uint64_t> cn;
+    uint64_t cn_sum = 0;
+    uint64_t long_words_bytes = 0;   // объем строк, не умещающихся во внутренний буфер std::string
+    uint64_t size() const { return cn.size(); }
+  };
+  // синтетический словарь для калибровочного прогона (частоты берутся у наиболее частотных записей настоящего словаря)
+  class SyntheticVocabulary : public CustomVocabulary
+  {
+  public:
+    SyntheticVocabulary(const VocabSummary& vs, size_t rows, float sample)
+    {
+      for (size_t i = 0; i < std::min<size_t>(rows, vs.size()); ++i)
+        append(std::string(), vs.cn[i]);
+      sampling_estimation(sample);
+    }
+    size_t word_to_idx(const std::string&) const override
+    {
+      return std::numeric_limits<size_t>::max();
+    }
+  };
+
+  static bool scan_vocab(const std::string& filename, VocabSummary& vs)
+  {
+    std::ifstream ifs( filename );
+    if (!ifs.good())
+    {
+      std::cerr << "Can't open vocabulary file: " << filename << std::endl;
+      return false;
+    }
+    const size_t SSO_CAPACITY = std::string().capacity();
+    std::string buf;
+    while ( std::getline(ifs, buf).good() )
+    {
+      const size_t sep = buf.find_last_of(" \t");
+      if ( sep == std::string::npos )
+      {
+        std::cerr << "Vocabulary loading error: " << filename << std::endl;
+        std::cerr << "Invalid record: " << buf << std::endl;
+        return false;
+      }
+      const uint64_t cn = std::strtoull(buf.c_str() + sep + 1, nullptr, 10);
+      vs.cn.push_back(cn);
+      vs.cn_sum += cn;
+      if ( sep > SSO_CAPACITY )
+        vs.long_words_bytes += sep + 1;
+    }
+    return true;
+  } // method-end
+  // память, занимаемая словарем OriginalWord2VecVocabulary: вектор записей, хэш-отображение (корзины и узлы), строки в куче (дважды)
+  static uint64_t vocab_bytes(const VocabSummary& vs)
+  {
+    const uint64_t NODE_BYTES = sizeof(void*) + sizeof(std::pair<const std::string, size_t>) + sizeof(size_t);
+    uint64_t records_capacity = 1;
+    while ( records_capacity < vs.size() )
+      records_capacity *= 2;
+    return records_capacity * sizeof(VocabularyData)
+           + std::max<uint64_t>(VOCAB_HASH_RESERVE, vs.size()) * sizeof(void*)
+           + vs.size() * NODE_BYTES
+           + vs.long_words_bytes * 2;
+  } // method-end
+  // доля слов корпуса, остающихся после сабсэмплинга (та же формула, что и в CustomVocabulary::sampling_estimation)
+  static double kept_fraction(const VocabSummary& vs, float sample)
+  {
+    if ( sample == 0 || vs.cn_sum == 0 )
+      return 1.0;
+    const double wc_mul_sample = vs.cn_sum * static_cast<double>(sample);
+    double kept = 0;
+    for (auto cn : vs.cn)
+    {
+      const double t_to_f = wc_mul_sample / cn;
+      kept += cn * std::min(1.0, t_to_f + std::sqrt(t_to_f));
+    }
+    return kept / vs.cn_sum;
+  } // method-end
+  static double calibrate(const CommandLineParametersDefs& cmdLineParams, const CommandLineParametersDefs& cfg,
+                          const VocabSummary& words, const VocabSummary& deps, size_t threads_count)
+  {
+    const size_t size_d = cfg.getAsInt("-size_d");
+    const size_t size_a = cfg.getAsInt("-size_a");
+    auto v_words = std::make_shared<SyntheticVocabulary>(words, CALIBRATION_ROWS, cmdLineParams.getAsFloat("-sample_w"));
+    auto v_deps = (size_d > 0) ? std::make_shared<SyntheticVocabulary>(deps, CALIBRATION_ROWS, cmdLineParams.getAsFloat("-sample_d")) : nullptr;
+    Trainer trainer( nullptr, v_words, false, v_deps, (size_a > 0 ? v_words : nullptr),
+                     size_d, size_a, 0, cfg.getAsInt("-iter"),
+                     cfg.getAsFloat("-alpha_d"), cfg.getAsFloat("-alpha_a"), std::numeric_limits<float>::quiet_NaN(),
+                     cfg.getAsFloat("-inflection"), cfg.getAsInt("-negative_d"), cfg.getAsInt("-negative_a"),
+                     threads_count, CALIBRATION_NOISE_TABLE );
+    if ( cfg.getAsString("-objective_d") == "hs" )
+      trainer.set_dep_hierarchical_softmax();
+    trainer.create_net();
+    trainer.init_net();
+    if ( cfg.getAsInt("-adagrad") == 1 )
+      trainer.enable_adagrad();
+    trainer.set_poly_sigmoid( cfg.getAsString("-sigmoid") == "poly" );
+    return trainer.calibrate(threads_count, CALIBRATION_SECONDS, DEP_CTX_PER_WORD, (size_a > 0 ? ASSOC_CTX_PER_WORD : 0));
+  } // method-end
+  // скорость чтения и разбора корпуса одним потоком (слов в секунду); 0 -- оценить не удалось
+  static double calibrate_reading(const std::string& filename)
+  {
+    if ( filename == "stdin" )
+      return 0;
+    ConllReader cr(filename);
+    if ( !cr.init() )
+      return 0;
+    ConllReader::SentenceMatrix sentence;
+    uint64_t words = 0;
+    const auto start_tp = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    while ( elapsed.count() < READING_CALIBRATION_SECONDS && cr.read_sentence(sentence) )
+    {
+      words += sentence.size();
+      elapsed = std::chrono::steady_clock::now() - start_tp;
+    }
+    cr.fin();
+    return ( words > 0 && elapsed.count() > 0 ) ? words / elapsed.count() : 0;
+  } // method-end
+  static uint64_t print_item(const std::string& name, uint64_t bytes)
+  {
+    std::cout << "  " << std::left << std::setw(ITEM_WIDTH) << name << human(bytes) << std::endl;
+    return bytes;
+  } // method-end
+  static std::string human(uint64_t bytes)
+  {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1);
+    if ( bytes >= (1ULL << 30) )
+      oss << bytes / double(1ULL << 30) << " GB";
+    else
+      oss << bytes / double(1ULL << 20) << " MB";
+    return oss.str();
+  } // method-end
+  static uint64_t physical_memory()
+  {
+#ifndef _MSC_VER
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long page_size = sysconf(_SC_PAGESIZE);
+    if ( pages > 0 && page_size > 0 )
+      return static_cast<uint64_t>(pages) * page_size;
+#endif
+    return 0;
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* DRY_RUN_PLANNER_H_ */
@@ -8,10 +8,12 @@
 #include <string>
 #include <vector>
 #include <utility>
-#include <set>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
 #include <fstream>
 #include <iostream>
-#include <atomic>
+#include <optional>
 
 
 // Информация о словаре и о том, как его использовать для обучения векторной модели (а также сами словарные данные)
@@ -26,7 +28,35 @@ struct VocabUsageInfo
   float e_dist_limit = 0; // предел стягивания (по евклидову расстоянию)
 
   std::vector< std::tuple<size_t, size_t, float> > data;  // сами данные словаря -- пары индексов слов и вес связи
-  mutable std::atomic_uint counter{0};                    // счетчик для выбора обучающих примеров с заданной частотой сэмплирования (rate)
+  // гнезда попарно связанных слов (evaPairwise, evaPairwiseEuclidean) в пары не разворачиваются (k слов дали бы k(k-1)/2 записей),
+  // а хранятся компактно (CSR): слова гнезда n -- nest_ids[ nest_offsets[n] .. nest_offsets[n+1] ), пары вычисляются при выборке
+  std::vector<uint32_t> nest_ids;
+  std::vector<uint64_t> nest_offsets{0};
+  std::vector<uint64_t> nest_pairs{0};    // накопленное количество пар: в гнездах 0..n-1 содержится nest_pairs[n] пар
+
+  // общее количество пар словаря
+  uint64_t pairs_count() const
+  {
+    return data.size() + nest_pairs.back();
+  }
+  // пара с номером k (нумерация совпадает с порядком, в котором пары гнезд перечислялись бы при развертывании)
+  std::tuple<size_t, size_t, float> pair(uint64_t k) const
+  {
+    if ( !data.empty() )
+      return data[k];
+    const size_t n = std::upper_bound(nest_pairs.begin(), nest_pairs.end(), k) - nest_pairs.begin() - 1;
+    const uint64_t nest_size = nest_offsets[n+1] - nest_offsets[n];
+    const uint32_t* nest = nest_ids.data() + nest_offsets[n];
+    // пары гнезда упорядочены как (0,1), (0,2), ..., (0,m-1), (1,2), ...; строка i содержит m-1-i пар
+    uint64_t local = k - nest_pairs[n];
+    uint64_t i = 0;
+    while ( local >= nest_size - 1 - i )
+    {
+      local -= nest_size - 1 - i;
+      ++i;
+    }
+    return std::make_tuple( nest[i], nest[i + 1 + local], 1.0 );
+  }
 };
 
 
@@ -83,11 +113,19 @@ public:
   {
     if ( !wordsVocabulary )
       return false;
+    // индексы слов в гнездах хранятся 32-битными
+    if ( wordsVocabulary->size() > std::numeric_limits<uint32_t>::max() )
+    {
+      std::cerr << "Vocabulary is too large for external vocabs" << std::endl;
+      return false;
+    }
     for (auto& vptr : records)
     {
       auto& v = *vptr;
       v.data.clear();
-      v.counter = 0;
+      v.nest_ids.clear();
+      v.nest_offsets.assign(1, 0);
+      v.nest_pairs.assign(1, 0);
       std::ifstream ifs(v.vocab_filename);
       if (!ifs.good())
       {
@@ -115,31 +153,74 @@ public:
     } // for all vocabs
     return true;
   }
+  // количество словарей (размер векторов счетчиков, используемых для темпирования)
+  size_t size() const
+  {
+    return records.size();
+  }
   // наполенние структуры result обучающими данными (вызывается из нескольких потоков!!!)
-  void get(std::vector<ExtVocabExample>& result, const float fraction, unsigned long long next_random) const
+  // counters -- собственные счетчики вызывающего потока (по одному на словарь) для выбора каждого rate-го обучающего примера;
+  // общий для всех потоков атомарный счетчик здесь не используется -- он становился точкой конкуренции
+  void get(std::vector<ExtVocabExample>& result, const float fraction, unsigned long long next_random, std::vector<size_t>& counters) const
   {
-    for (auto& vptr : records)
+    if ( counters.size() != records.size() )
+      counters.assign(records.size(), 0);
+    for (size_t r = 0; r < records.size(); ++r)
     {
-      auto& v = *vptr;
-      if ( v.data.empty() )
+      auto& v = *records[r];
+      if ( !is_active(v, fraction) )
         continue;
-      if ( fraction < v.fraction_range.first || fraction > v.fraction_range.second )
+      if ( ++counters[r] % v.rate == 0 )
+        add_pack(result, v, v.pack, next_random);
+    }
+  }
+  // наполнение структуры result обучающими данными для выделенного потока-исполнителя:
+  // за examples_delta обработанных (с момента предыдущего вызова) обучающих примеров каждый активный словарь выдает
+  // по pack пар на каждые rate примеров; неизрасходованный остаток примеров накапливается в residual (по одному на словарь)
+  void get_paced(std::vector<ExtVocabExample>& result, const float fraction, uint64_t examples_delta,
+                 std::vector<uint64_t>& residual, unsigned long long& next_random) const
+  {
+    if ( residual.size() != records.size() )
+      residual.assign(records.size(), 0);
+    for (size_t r = 0; r < records.size(); ++r)
+    {
+      auto& v = *records[r];
+      if ( !is_active(v, fraction) )
         continue;
-      if ( ++v.counter % v.rate == 0 )
-      {
-        for (size_t i = 0; i < v.pack; ++i)
-        {
-          next_random = next_random * (unsigned long long)25214903917 + 11;
-          auto& selected = v.data[ next_random % v.data.size() ];
-          result.emplace_back( v.dims_range, selected, v.algo, v.e_dist_limit );
-        }
-      }
+      residual[r] += examples_delta;
+      const uint64_t packs = residual[r] / v.rate;
+      residual[r] %= v.rate;
+      add_pack(result, v, packs * v.pack, next_random);
     }
   }
+  // получение наибольшего номера измерения, затрагиваемого внешними словарями (для контроля соответствия размерности модели)
+  std::optional<size_t> get_max_dim() const
+  {
+    std::optional<size_t> result;
+    for (auto& vptr : records)
+      if ( !result || vptr->dims_range.second > result.value() )
+        result = vptr->dims_range.second;
+    return result;
+  }
 private:
   // вектор информации о словарях
   std::vector< std::unique_ptr<VocabUsageInfo> > records;
 
+  // используется ли словарь на текущей стадии обучения
+  static bool is_active(const VocabUsageInfo& v, const float fraction)
+  {
+    return v.pairs_count() > 0 && fraction >= v.fraction_range.first && fraction <= v.fraction_range.second;
+  }
+  // случайный выбор count пар из словаря
+  static void add_pack(std::vector<ExtVocabExample>& result, const VocabUsageInfo& v, size_t count, unsigned long long& next_random)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      next_random = next_random * (unsigned long long)25214903917 + 11;
+      result.emplace_back( v.dims_range, v.pair(next_random % v.pairs_count()), v.algo, v.e_dist_limit );
+    }
+  }
+
   void print_table_dbg() const
   {
     std::cout << "External vocabs table" << std::endl;
@@ -161,9 +242,16 @@ private:
       std::cerr << "Invalid record (count) in " << filename << ": " << line << std::endl;
       return false;
     }
-    std::set<std::string> dedoubler;
-    std::copy(items.begin(), items.end(), std::inserter(dedoubler, dedoubler.begin()));
-    if (items.size() != dedoubler.size())
+    // проверка на дубликаты: записи короткие, поэтому сравниваем попарно (без построения множества для каждой строки)
+    bool has_duplicates = false;
+    for (size_t i = 1; i < items.size() && !has_duplicates; ++i)
+      for (size_t j = 0; j < i; ++j)
+        if ( items[i] == items[j] )
+        {
+          has_duplicates = true;
+          break;
+        }
+    if (has_duplicates)
     {
       std::cerr << "Invalid record (duplicates) in " << filename << ": " << line << std::endl;
       return false;
@@ -195,7 +283,7 @@ private:
   void pairwise_helper(VocabUsageInfo& v, const std::vector<std::string>& items, std::shared_ptr<OriginalWord2VecVocabulary> wordsVocabulary, const std::string& filename)
   {
     constexpr size_t INVALID_IDX = std::numeric_limits<size_t>::max();
-    std::vector<size_t> nest;
+    const size_t nest_start = v.nest_ids.size();
     for (auto& word : items)
     {
       size_t idx = wordsVocabulary->word_to_idx(word);
@@ -204,16 +292,17 @@ private:
         //std::cerr << "Skip unknown word '" << word << "' in " << filename << std::endl;
         continue;
       }
-      nest.push_back(idx);
+      v.nest_ids.push_back(idx);
     }
-    if (nest.size() < 2)
+    const uint64_t nest_size = v.nest_ids.size() - nest_start;
+    if (nest_size < 2)
     {
       //std::cerr << "Too small nest in " << filename << ": " << items[0] << " ..." << std::endl;
+      v.nest_ids.resize(nest_start);
       return;
     }
-    for (size_t i = 0; i < nest.size()-1; ++i)
-      for (size_t j = i+1; j < nest.size(); ++j)
-        v.data.push_back( std::make_tuple( nest[i], nest[j], 1.0 ) );
+    v.nest_offsets.push_back( v.nest_ids.size() );
+    v.nest_pairs.push_back( v.nest_pairs.back() + nest_size * (nest_size - 1) / 2 );
   }
 
   void first_weighted_helper(VocabUsageInfo& v, const std::vector<std::string>& items, std::shared_ptr<OriginalWord2VecVocabulary> wordsVocabulary, const std::string& filename)
@@ -243,14 +332,17 @@ private:
   void print_stat_dbg(VocabUsageInfo& v) const
   {
     std::cout << "Vocab: " << v.vocab_filename << std::endl;
-    std::cout << "  pairs count = " << v.data.size() << std::endl;
-    std::set<size_t> w;
+    std::cout << "  pairs count = " << v.pairs_count() << std::endl;
+    std::vector<size_t> w(v.nest_ids.begin(), v.nest_ids.end());
     for (auto& r : v.data)
     {
-      w.insert(std::get<0>(r));
-      w.insert(std::get<1>(r));
+      w.push_back(std::get<0>(r));
+      w.push_back(std::get<1>(r));
     }
-    std::cout << "  words count = " << w.size() << std::endl;
+    std::sort(w.begin(), w.end());
+    std::cout << "  words count = " << (std::unique(w.begin(), w.end()) - w.begin()) << std::endl;
+    if ( v.nest_offsets.size() > 1 )
+      std::cout << "  nests count = " << (v.nest_offsets.size() - 1) << std::endl;
   }
 
 };
@@ -0,0 +1,72 @@
+#ifndef FAST_SIGMOID_H_
+#define FAST_SIGMOID_H_
+
+#include <cstdint>
+#include <cstring>       // for std::memcpy
+#include <cstddef>
+#include <cmath>
+
+
+// Логистическая функция без таблицы: exp вычисляется через разложение x = n*ln2 + r (|r| <= ln2/2),
+// 2^n собирается непосредственно в битах порядка float, exp(r) -- полиномом 6-й степени (коэффициенты Cephes).
+// Код не содержит ветвлений и обращений к памяти, поэтому цикл пакетного вычисления векторизуется компилятором.
+// Семантика барьера совпадает с табличной сигмоидой Trainer: за пределами [-bound, bound] возвращаются забарьерные значения.
+class FastSigmoid
+{
+public:
+  static constexpr float BARRIER_HI = 0.99999999;
+  static constexpr float BARRIER_LO = 0.00000001;
+  // exp(x) для |x| <= 87 (относительная погрешность порядка 1e-7)
+  static inline float exp(float x)
+  {
+    const float LOG2E = 1.44269504088896341f;
+    const float LN2_HI = 0.693359375f;      // ln2 разбит на две части для точного вычисления остатка
+    const float LN2_LO = -2.12194440e-4f;
+    // округление до ближайшего целого через усечение положительного числа (cvttps2dq векторизуется и без SSE4.1)
+    const int32_t n = static_cast<int32_t>( x * LOG2E + 128.5f ) - 128;
+    const float fn = static_cast<float>(n);
+    const float r = x - fn * LN2_HI - fn * LN2_LO;
+    float p = 1.9875691500E-4f;
+    p = p * r + 1.3981999507E-3f;
+    p = p * r + 8.3334519073E-3f;
+    p = p * r + 4.1665795894E-2f;
+    p = p * r + 1.6666665459E-1f;
+    p = p * r + 5.0000001201E-1f;
+    p = p * r * r + r + 1.0f;
+    const int32_t bits = (n + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+  } // method-end
+  static inline float value(float x, float bound)
+  {
+    // аргумент ограничивается до вычисления exp, барьер применяется к результату;
+    // выбор значения выполняется битовой маской: при условном выражении (и std::min/std::max) компилятор
+    // вносит последующие вычисления в ветви и (т.к. они могут генерировать FP-исключения) отказывается от векторизации
+    const bool above = std::isgreater(x, bound);
+    const bool below = std::isless(x, -bound);
+    const float xc = select( above, bound, select(below, -bound, x) );
+    const float s = 1.0f / (1.0f + FastSigmoid::exp(-xc));
+    return select( below, BARRIER_LO, select(above, BARRIER_HI, s) );
+  } // method-end
+  static inline float select(bool cond, float a, float b)
+  {
+    const uint32_t mask = -static_cast<uint32_t>(cond);
+    uint32_t ia, ib;
+    std::memcpy(&ia, &a, sizeof(ia));
+    std::memcpy(&ib, &b, sizeof(ib));
+    const uint32_t ir = (ia & mask) | (ib & ~mask);
+    float result;
+    std::memcpy(&result, &ir, sizeof(result));
+    return result;
+  } // method-end
+  // пакетное вычисление (in-place допустимо)
+  static void batch(const float* x, float* y, size_t n, float bound)
+  {
+    for (size_t i = 0; i < n; ++i)
+      y[i] = value(x[i], bound);
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* FAST_SIGMOID_H_ */
@@ -0,0 +1,101 @@
+#ifndef HEAVY_HITTERS_H_
+#define HEAVY_HITTERS_H_
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+
+
+// Приближенный подсчет частот в ограниченной памяти (count-min sketch) для отбора ключей, достигающих частотного порога.
+// Пока оценка частоты ключа ниже порога, вхождения учитываются только в скетче; как только оценка достигает порога,
+// ключ становится кандидатом, и дальнейшие вхождения считаются точно (в словаре кандидатов, вне этого класса).
+// Оценка скетча не меньше числа учтенных в нем вхождений ключа, поэтому итоговая частота кандидата
+// (оценка скетча + точный подсчет) не меньше истинной, а каждый ключ с частотой не ниже порога становится кандидатом.
+// Счетчики атомарные -- скетч используется всеми потоками подсчета без блокировок.
+// Ограничена только память скетча: при его недостаточном объеме (насыщении, см. get_mean_cell) кандидатами становятся и
+// редкие ключи, а словарь кандидатов растет без ограничений.
+class HeavyHitters
+{
+public:
+  // результат учета вхождения ключа
+  enum class Hit
+  {
+    Below,      // вхождение учтено в скетче, оценка частоты ключа ниже порога
+    Crossed,    // вхождение учтено в скетче, и оценка частоты достигла порога (ключ стал кандидатом)
+    Candidate   // ключ уже является кандидатом: вхождение в скетче не учтено и должно быть подсчитано точно
+  };
+  explicit HeavyHitters(uint64_t memory_bytes)
+  {
+    width = 1024;
+    while ( width * 2 * DEPTH * sizeof(uint32_t) <= memory_bytes )
+      width *= 2;
+    cells = std::vector< std::atomic<uint32_t> >(width * DEPTH);
+  }
+  // учет вхождения ключа (порог отбора кандидатов для каждого ключа должен быть постоянным)
+  Hit add(const std::string& key, uint64_t threshold)
+  {
+    size_t idx[DEPTH];
+    cell_indexes(key, idx);
+    if ( min_cell(idx) >= threshold )
+      return Hit::Candidate; // скетч больше не наращиваем (это же исключает переполнение счетчиков частых ключей)
+    uint64_t est = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 0; i < DEPTH; ++i)
+      est = std::min<uint64_t>(est, cells[idx[i]].fetch_add(1, std::memory_order_relaxed) + 1);
+    return ( est >= threshold ) ? Hit::Crossed : Hit::Below;
+  } // method-end
+  // оценка (сверху) числа вхождений ключа, учтенных в скетче
+  uint64_t estimate(const std::string& key) const
+  {
+    size_t idx[DEPTH];
+    cell_indexes(key, idx);
+    return min_cell(idx);
+  } // method-end
+  uint64_t get_memory_size() const
+  {
+    return cells.size() * sizeof(uint32_t);
+  } // method-end
+  // средняя величина ячейки -- ожидаемая ошибка оценки в одной строке скетча
+  // (сопоставимая с порогом величина означает насыщение: кандидатами становятся и ключи с частотой заметно ниже порога)
+  double get_mean_cell() const
+  {
+    uint64_t total = 0;
+    for (auto& c : cells)
+      total += c.load(std::memory_order_relaxed);
+    return static_cast<double>(total) / cells.size();
+  } // method-end
+private:
+  static constexpr size_t DEPTH = 4;
+  size_t width;
+  std::vector< std::atomic<uint32_t> > cells;
+
+  uint64_t min_cell(const size_t* idx) const
+  {
+    uint64_t est = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 0; i < DEPTH; ++i)
+      est = std::min<uint64_t>(est, cells[idx[i]].load(std::memory_order_relaxed));
+    return est;
+  } // method-end
+  static inline uint64_t mix(uint64_t x)
+  {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+  } // method-end
+  // номера ячеек ключа в каждой строке скетча (две хэш-функции комбинируются: h1 + i*h2)
+  void cell_indexes(const std::string& key, size_t* idx) const
+  {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (unsigned char c : key)
+      h = (h ^ c) * 0x100000001B3ULL;
+    const uint64_t h1 = mix(h);
+    const uint64_t h2 = mix(h1) | 1;
+    for (size_t i = 0; i < DEPTH; ++i)
+      idx[i] = i * width + ((h1 + i * h2) & (width - 1));
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* HEAVY_HITTERS_H_ */
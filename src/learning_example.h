@@ -4,6 +4,7 @@
 #include <vector>
 #include <utility>
 #include <tuple>
+#include <cstdint>
 
 
 // алгоритм стягивания/отталкивания (для работы со внешними словарями)
@@ -38,6 +39,7 @@ struct LearningExample
   std::vector<size_t> dep_context;                          // индексы синтаксических контекстов
   std::vector<size_t> assoc_context;                        // индексы ассоциативных контекстов
   std::vector<ExtVocabExample> ext_vocab_data;              // дополнительные воздействия на основе данных внешних словарей
+  uint64_t grammemes = 0;                                   // битовая маска граммем (для обучения грамматических векторов)
 };
 
 
@@ -8,12 +8,16 @@
 #include "str_conv.h"
 #include "learning_example.h"
 #include "command_line_parameters_defs.h"
+#include "bounded_queue.h"
 
 #include <memory>
 #include <vector>
+#include <unordered_map>
 #include <optional>
 #include <cstring>       // for std::strerror
 #include <cmath>
+#include <thread>
+#include <mutex>
 
 //#include "log.h"
 
@@ -26,11 +30,18 @@ struct ThreadEnvironment
   unsigned long long next_random;                      // поле для вычисления случайных величин
   unsigned long long words_count;                      // количество прочитанных словарных слов
   std::vector< std::vector<std::string> > sentence_matrix; // conll-матрица для предложения
+  std::unordered_map<std::string, uint64_t> msd_cache; // кэш преобразования MSD-строк в маски граммем
+  std::vector<size_t> ext_counters;                    // счетчики обучающих примеров для темпирования внешних словарей
+  std::vector< std::vector< std::vector<std::string> > > stream_batch; // пакет предложений, полученный из потока (при потоковом чтении корпуса)
+  size_t stream_pos;                                   // позиция в пакете
+  size_t epochs_started;                               // количество начатых потоком эпох
   ThreadEnvironment()
   : cr(nullptr)
   , position_in_sentence(-1)
   , next_random(0)
   , words_count(0)
+  , stream_pos(0)
+  , epochs_started(0)
   {
     sentence.reserve(1000);
     sentence_matrix.reserve(1000);
@@ -57,7 +68,8 @@ public:
                           size_t embColumn, bool oov, size_t oovMaxLen,
                           std::shared_ptr< ExternalVocabsManager > ext_vm = nullptr)
   : threads_count( cmdLineParams.getAsInt("-threads") )
-  , train_filename( cmdLineParams.getAsString("-train") )
+  , train_filename( cmdLineParams.isDefined("-train") ? cmdLineParams.getAsString("-train") : std::string() )
+  , train_command( cmdLineParams.isDefined("-train_cmd") ? cmdLineParams.getAsString("-train_cmd") : std::string() )
   , words_vocabulary(wordsVocabulary)
   , toks_train(trainTokens)
   , dep_ctx_vocabulary(depCtxVocabulary)
@@ -85,18 +97,39 @@ public:
       dep_ctx_vocabulary->sampling_estimation(sample_d);
     if ( assoc_ctx_vocabulary )
       assoc_ctx_vocabulary->sampling_estimation(sample_a);
-    for (size_t i = 0; i < threads_count; ++i)
-      thread_environment[i].cr = std::make_unique<ConllReader>(train_filename);
+    if ( is_streaming() )
+      stream_queue = std::make_unique< BoundedQueue<SentencesBatch> >(STREAM_QUEUE_CAPACITY);
+    else
+    {
+      for (size_t i = 0; i < threads_count; ++i)
+        thread_environment[i].cr = std::make_unique<ConllReader>(train_filename);
+    }
   } // constructor-end
   // деструктор
   ~LearningExampleProvider()
   {
+    if ( stream_queue )
+      stream_queue->close();
+    if ( stream_reader.joinable() )
+      stream_reader.join();
   }
+  // корпус читается потоком (из stdin или вывода команды), а не из файла с произвольным доступом
+  bool is_streaming() const
+  {
+    return train_filename == "stdin" || !train_command.empty();
+  } // method-end
   // подготовительные действия, выполняемые перед каждой эпохой обучения
   bool epoch_prepare(size_t threadIndex)
   {
     auto& t_environment = thread_environment[threadIndex];
-    if ( !t_environment.cr->init_multithread(threadIndex, threads_count) )
+    if ( is_streaming() )
+    {
+      if ( !stream_start_epoch(++t_environment.epochs_started) )
+        return false;
+      t_environment.stream_batch.clear();
+      t_environment.stream_pos = 0;
+    }
+    else if ( !t_environment.cr->init_multithread(shard_idx * threads_count + threadIndex, shards_count * threads_count) )
     {
       std::cerr << "LearningExampleProvider: epoch prepare error" << std::endl;
       return false;
@@ -106,11 +139,24 @@ public:
     t_environment.words_count = 0;
     return true;
   } // method-end
+  // ограничение чтения частью корпуса (при распределенном обучении корпус делится между узлами поровну по размеру)
+  void set_shard(size_t shardIndex, size_t shardsCount)
+  {
+    shard_idx = shardIndex;
+    shards_count = shardsCount;
+    for (size_t i = 0; i < threads_count; ++i)
+      thread_environment[i].next_random = shard_idx * threads_count + i;
+  } // method-end
+  size_t get_threads_count() const
+  {
+    return threads_count;
+  } // method-end
   // заключительные действия, выполняемые после каждой эпохой обучения
   bool epoch_unprepare(size_t threadIndex)
   {
     auto& t_environment = thread_environment[threadIndex];
-    t_environment.cr->fin();
+    if ( t_environment.cr )
+      t_environment.cr->fin();
     return true;
   } // method-end
   // получение очередного обучающего примера
@@ -121,13 +167,15 @@ public:
     if (t_environment.sentence.empty())
     {
       t_environment.position_in_sentence = 0;
-      if ( t_environment.words_count > train_words / threads_count ) // не настал ли конец эпохи?
+      // при потоковом чтении потоки получают предложения по мере готовности, и эпоха заканчивается вместе с потоком данных
+      if ( !is_streaming() && t_environment.words_count > train_words / (threads_count * shards_count) ) // не настал ли конец эпохи?
         return std::nullopt;
       auto& sentence_matrix = t_environment.sentence_matrix;
       do
       {
 
-        bool is_read_ok = t_environment.cr->read_sentence(sentence_matrix);
+        bool is_read_ok = is_streaming() ? stream_read_sentence(t_environment, sentence_matrix)
+                                         : t_environment.cr->read_sentence(sentence_matrix);
         if ( !is_read_ok ) // не настал ли конец эпохи? (вычитали весь файл или ошибка чтения)
           return std::nullopt;
         if ( sentence_matrix.empty() ) // предохранитель
@@ -255,7 +303,7 @@ public:
 
         if (ext_vocabs_manager)
         {
-          ext_vocabs_manager->get(le.ext_vocab_data, fraction, t_environment.next_random);
+          ext_vocabs_manager->get(le.ext_vocab_data, fraction, t_environment.next_random, t_environment.ext_counters);
         }
 
         t_environment.sentence.push_back(le);
@@ -277,7 +325,7 @@ public:
       if ( word_idx != INVALID_IDX )
       {
         ++t_environment.words_count;
-        if (sample_w > 0)
+        if (sample_w > 0 && gramm_subsampling)
         {
           float ran = words_vocabulary->idx_to_data(word_idx).sample_probability;
           t_environment.update_random();
@@ -286,7 +334,7 @@ public:
         }
         LearningExample le;
         le.word = word_idx;
-        msd2vec(le, sentence_matrix[i][Conll::FEATURES]);  // конструирование грамматического вектора из набора граммем
+        le.grammemes = msd_to_mask(t_environment, sentence_matrix[i][Conll::FEATURES]);  // конструирование грамматического вектора из набора граммем
         t_environment.sentence.push_back(le);
       }
       if (train_oov)
@@ -312,7 +360,7 @@ public:
       if ( word_idx != INVALID_IDX )
       {
         ++t_environment.words_count;
-        if (sample_w > 0)
+        if (sample_w > 0 && gramm_subsampling)
         {
           float ran = words_vocabulary->idx_to_data(word_idx).sample_probability;
           t_environment.update_random();
@@ -321,7 +369,7 @@ public:
         }
         LearningExample le;
         le.word = word_idx;
-        msd2vec(le, msd);  // конструирование грамматического вектора из набора граммем
+        le.grammemes = msd_to_mask(t_environment, msd);  // конструирование грамматического вектора из набора граммем
         t_environment.sentence.push_back(le);
       }
     }
@@ -337,6 +385,12 @@ public:
     return gcLast;
   }
   // изменение subsampling-коэффициентов в динамике
+  // включение/отключение сэмплирования при извлечении примеров для грамматических векторов
+  // (отключается при построении таблицы примеров -- там частоты учитываются весами)
+  void set_gramm_subsampling(bool value)
+  {
+    gramm_subsampling = value;
+  }
   void update_subsampling_rates(float w_mul = 0.8 /*, float d_mul = 0.8, float a_mul = 0.8*/)
   {
     sample_w *= w_mul; /*sample_d *= d_mul; sample_a *= a_mul;*/
@@ -350,10 +404,17 @@ public:
 private:
   // количество потоков управления (thread), параллельно работающих с поставщиком обучающих примеров
   size_t threads_count = 0;
+  // применять ли сэмплирование при извлечении примеров для грамматических векторов
+  bool gramm_subsampling = true;
+  // часть корпуса, обрабатываемая данным процессом (при распределенном обучении)
+  size_t shard_idx = 0;
+  size_t shards_count = 1;
   // информация, описывающая рабочие контексты потоков управления (thread)
   std::vector<ThreadEnvironment> thread_environment;
   // имя файла, содержащего обучающее множество (conll)
   std::string train_filename;
+  // команда, выводящая обучающее множество (выполняется заново в каждой эпохе)
+  std::string train_command;
   // количество слов в обучающем множестве (приблизительно, т.к. могло быть подрезание по порогу частоты при построении словаря)
   uint64_t train_words = 0;
   // словари
@@ -381,6 +442,77 @@ private:
   std::shared_ptr< ExternalVocabsManager > ext_vocabs_manager;
   // минимальная длина слова, от которого берутся oov-суффиксы
   const size_t SFX_SOURCE_WORD_MIN_LEN = 6;
+  // потоковое чтение корпуса: единственный поток-читатель разбирает conll и раздает предложения рабочим потокам пакетами
+  // через очередь ограниченной емкости (читатель не убегает вперед, а рабочие потоки не конкурируют за каждое предложение)
+  typedef std::vector< ConllReader::SentenceMatrix > SentencesBatch;
+  static constexpr size_t STREAM_BATCH_SIZE = 256;
+  static constexpr size_t STREAM_QUEUE_CAPACITY = 64;
+  std::unique_ptr< BoundedQueue<SentencesBatch> > stream_queue;
+  std::thread stream_reader;
+  std::mutex stream_mtx;
+  size_t stream_epoch = 0;
+  bool stream_failed = false;
+
+  // запуск чтения очередной эпохи (первым из потоков, начавших эпоху); поток, позже других закончивший предыдущую эпоху,
+  // может успеть получить часть предложений новой эпохи -- на общий объем обучающих данных это не влияет
+  bool stream_start_epoch(size_t epoch)
+  {
+    std::lock_guard<std::mutex> lock(stream_mtx);
+    if ( epoch <= stream_epoch )
+      return !stream_failed;
+    if ( stream_reader.joinable() )
+      stream_reader.join();
+    stream_epoch = epoch;
+    if ( train_command.empty() && epoch > 1 )
+    {
+      std::cerr << "LearningExampleProvider: stdin corpus can be read only once" << std::endl;
+      stream_failed = true;
+      return false;
+    }
+    auto reader = std::make_shared<ConllReader>(train_filename);
+    bool succ = train_command.empty() ? reader->init() : reader->init_command(train_command);
+    if ( !succ )
+    {
+      std::cerr << "LearningExampleProvider: epoch prepare error" << std::endl;
+      stream_failed = true;
+      stream_queue->close();
+      return false;
+    }
+    stream_queue->reopen();
+    stream_reader = std::thread( [this, reader]()
+    {
+      SentencesBatch batch;
+      ConllReader::SentenceMatrix sentence;
+      while ( reader->read_sentence(sentence) )
+      {
+        batch.push_back( std::move(sentence) );
+        if ( batch.size() == STREAM_BATCH_SIZE )
+        {
+          if ( !stream_queue->push( std::move(batch) ) )
+            break;
+          batch = SentencesBatch();
+          batch.reserve(STREAM_BATCH_SIZE);
+        }
+      }
+      if ( !batch.empty() )
+        stream_queue->push( std::move(batch) );
+      reader->fin();
+      stream_queue->close();
+    } );
+    return true;
+  } // method-end
+  // получение очередного предложения из потока
+  bool stream_read_sentence(ThreadEnvironment& t_environment, ConllReader::SentenceMatrix& result)
+  {
+    if ( t_environment.stream_pos == t_environment.stream_batch.size() )
+    {
+      if ( !stream_queue->pop(t_environment.stream_batch) )
+        return false;
+      t_environment.stream_pos = 0;
+    }
+    result = std::move( t_environment.stream_batch[t_environment.stream_pos++] );
+    return true;
+  } // method-end
 
 //  // быстрый конвертер строки в число (без какого-либо контроля корректности)
 //  unsigned int string2uint_ultrafast(const std::string& value)
@@ -462,240 +594,257 @@ private:
 
     gcLast
   };
-  void encodeGender(char value, LearningExample& le)
+  static_assert(gcLast <= 64, "Grammemes must fit into 64-bit mask");
+  static inline uint64_t grammeme_bit(GramCode2VecPosition pos)
+  {
+    return 1ULL << pos;
+  }
+  // получение маски граммем через кэш потока (набор различных MSD-строк невелик)
+  uint64_t msd_to_mask(ThreadEnvironment& t_environment, const std::string& msd) const
+  {
+    auto it = t_environment.msd_cache.find(msd);
+    if ( it != t_environment.msd_cache.end() )
+      return it->second;
+    uint64_t mask = msd2mask(msd);
+    t_environment.msd_cache.emplace(msd, mask);
+    return mask;
+  }
+  static void encodeGender(char value, uint64_t& mask)
   {
     switch(value)
     {
-    case 'm': le.assoc_context[gcGendMas] = 1; break;
-    case 'f': le.assoc_context[gcGendFem] = 1; break;
-    case 'n': le.assoc_context[gcGendNeu] = 1; break;
+    case 'm': mask |= grammeme_bit(gcGendMas); break;
+    case 'f': mask |= grammeme_bit(gcGendFem); break;
+    case 'n': mask |= grammeme_bit(gcGendNeu); break;
     }
   }
-  void encodeNumber(char value, LearningExample& le)
+  static void encodeNumber(char value, uint64_t& mask)
   {
     switch(value)
     {
-    case 's': le.assoc_context[gcNumSing] = 1; break;
-    case 'p': le.assoc_context[gcNumPlur] = 1; break;
+    case 's': mask |= grammeme_bit(gcNumSing); break;
+    case 'p': mask |= grammeme_bit(gcNumPlur); break;
     }
   }
-  void encodeCase(char value, LearningExample& le)
+  static void encodeCase(char value, uint64_t& mask)
   {
     switch (value)
     {
-    case 'n': le.assoc_context[gcCaseNom] = 1; break;
-    case 'g': le.assoc_context[gcCaseGen] = 1; break;
-    case 'd': le.assoc_context[gcCaseDat] = 1; break;
-    case 'a': le.assoc_context[gcCaseAcc] = 1; break;
-    case 'i': le.assoc_context[gcCaseIns] = 1; break;
-    case 'l': le.assoc_context[gcCaseLoc] = 1; break;
-    case 'v': le.assoc_context[gcCaseVoc] = 1; break;
+    case 'n': mask |= grammeme_bit(gcCaseNom); break;
+    case 'g': mask |= grammeme_bit(gcCaseGen); break;
+    case 'd': mask |= grammeme_bit(gcCaseDat); break;
+    case 'a': mask |= grammeme_bit(gcCaseAcc); break;
+    case 'i': mask |= grammeme_bit(gcCaseIns); break;
+    case 'l': mask |= grammeme_bit(gcCaseLoc); break;
+    case 'v': mask |= grammeme_bit(gcCaseVoc); break;
     }
   }
-  void encodeAnim(char value, LearningExample& le)
+  static void encodeAnim(char value, uint64_t& mask)
   {
     switch(value)
     {
-    case 'y': le.assoc_context[gcAnimYes] = 1; break;
-    case 'n': le.assoc_context[gcAnimNo] = 1; break;
+    case 'y': mask |= grammeme_bit(gcAnimYes); break;
+    case 'n': mask |= grammeme_bit(gcAnimNo); break;
     }
   }
-  void encodeTense(char value, LearningExample& le)
+  static void encodeTense(char value, uint64_t& mask)
   {
     switch(value)
     {
-    case 'p': le.assoc_context[gcTensePre] = 1; break;
-    case 'f': le.assoc_context[gcTenseFut] = 1; break;
-    case 's': le.assoc_context[gcTensePast] = 1; break;
+    case 'p': mask |= grammeme_bit(gcTensePre); break;
+    case 'f': mask |= grammeme_bit(gcTenseFut); break;
+    case 's': mask |= grammeme_bit(gcTensePast); break;
     }
   }
-  void encodePerson(char value, LearningExample& le)
+  static void encodePerson(char value, uint64_t& mask)
   {
     switch(value)
     {
-    case '1': le.assoc_context[gcPers1] = 1; break;
-    case '2': le.assoc_context[gcPers2] = 1; break;
-    case '3': le.assoc_context[gcPers3] = 1; break;
+    case '1': mask |= grammeme_bit(gcPers1); break;
+    case '2': mask |= grammeme_bit(gcPers2); break;
+    case '3': mask |= grammeme_bit(gcPers3); break;
     }
   }
-  void encodeDefiniteness(char value, LearningExample& le)
+  static void encodeDefiniteness(char value, uint64_t& mask)
   {
     switch(value)
     {
-    case 's': le.assoc_context[gcDefShort] = 1; break;
-    case 'f': le.assoc_context[gcDefFull] = 1; break;
+    case 's': mask |= grammeme_bit(gcDefShort); break;
+    case 'f': mask |= grammeme_bit(gcDefFull); break;
     }
   }
-  void encodeDegree(char value, LearningExample& le)
+  static void encodeDegree(char value, uint64_t& mask)
   {
     switch(value)
     {
-    case 'p': le.assoc_context[gcDegrPos] = 1; break;
-    case 'c': le.assoc_context[gcDegrCom] = 1; break;
-    case 's': le.assoc_context[gcDegrSup] = 1; break;
+    case 'p': mask |= grammeme_bit(gcDegrPos); break;
+    case 'c': mask |= grammeme_bit(gcDegrCom); break;
+    case 's': mask |= grammeme_bit(gcDegrSup); break;
     }
   }
-  void msd2vec(LearningExample& le, const std::string& msd)
+  // конструирование грамматического вектора (битовой маски граммем) из MSD-строки
+  uint64_t msd2mask(const std::string& msd) const
   {
-    le.assoc_context.resize(gcLast, 0);
-    if (msd.empty()) return;
+    uint64_t mask = 0;
+    if (msd.empty()) return mask;
     if (msd[0] == 'N') // noun
     {
-      le.assoc_context[gcPosNoun] = 1;
+      mask |= grammeme_bit(gcPosNoun);
       for(size_t i = 1; i < msd.size(); ++i)
       {
-        if (i == 1 && msd[i] == 'c') le.assoc_context[gcNtCmn] = 1;
-        if (i == 1 && msd[i] == 'p') le.assoc_context[gcNtProper] = 1;
-        if (i == 2) encodeGender(msd[i], le);
-        if (i == 3) encodeNumber(msd[i], le);
-        if (i == 4) encodeCase(msd[i], le);
-        if (i == 5) encodeAnim(msd[i], le);
+        if (i == 1 && msd[i] == 'c') mask |= grammeme_bit(gcNtCmn);
+        if (i == 1 && msd[i] == 'p') mask |= grammeme_bit(gcNtProper);
+        if (i == 2) encodeGender(msd[i], mask);
+        if (i == 3) encodeNumber(msd[i], mask);
+        if (i == 4) encodeCase(msd[i], mask);
+        if (i == 5) encodeAnim(msd[i], mask);
       }
     }
     if (msd[0] == 'V') // verb
     {
-      le.assoc_context[gcPosVerb] = 1;
+      mask |= grammeme_bit(gcPosVerb);
       for(size_t i = 1; i < msd.size(); ++i)
       {
         if (i == 2)
         {
           switch (msd[i])
           {
-          case 'i': le.assoc_context[gcVfInd] = 1; break;
-          case 'm': le.assoc_context[gcVfImp] = 1; break;
-          case 'c': le.assoc_context[gcVfCond] = 1; break;
-          case 'n': le.assoc_context[gcVfInf] = 1; break;
-          case 'p': le.assoc_context[gcVfPart] = 1; break;
-          case 'g': le.assoc_context[gcVfGer] = 1; break;
+          case 'i': mask |= grammeme_bit(gcVfInd); break;
+          case 'm': mask |= grammeme_bit(gcVfImp); break;
+          case 'c': mask |= grammeme_bit(gcVfCond); break;
+          case 'n': mask |= grammeme_bit(gcVfInf); break;
+          case 'p': mask |= grammeme_bit(gcVfPart); break;
+          case 'g': mask |= grammeme_bit(gcVfGer); break;
           }
         }
-        if (i == 3) encodeTense(msd[i], le);
-        if (i == 4) encodePerson(msd[i], le);
-        if (i == 5) encodeNumber(msd[i], le);
-        if (i == 6) encodeGender(msd[i], le);
+        if (i == 3) encodeTense(msd[i], mask);
+        if (i == 4) encodePerson(msd[i], mask);
+        if (i == 5) encodeNumber(msd[i], mask);
+        if (i == 6) encodeGender(msd[i], mask);
         if (i == 7)
         {
           switch (msd[i])
           {
-          case 'a': le.assoc_context[gcVoiceAct] = 1; break;
-          case 'p': le.assoc_context[gcVoicePass] = 1; break;
+          case 'a': mask |= grammeme_bit(gcVoiceAct); break;
+          case 'p': mask |= grammeme_bit(gcVoicePass); break;
           }
         }
-        if (i == 8) encodeDefiniteness(msd[i], le);
+        if (i == 8) encodeDefiniteness(msd[i], mask);
         if (i == 9)
         {
           switch (msd[i])
           {
-          case 'p': le.assoc_context[gcAspProg] = 1; break;
-          case 'e': le.assoc_context[gcAspPerf] = 1; break;
+          case 'p': mask |= grammeme_bit(gcAspProg); break;
+          case 'e': mask |= grammeme_bit(gcAspPerf); break;
           }
         }
-        if (i == 10) encodeCase(msd[i], le);
+        if (i == 10) encodeCase(msd[i], mask);
       }
     }
     if (msd[0] == 'A') // adjective
     {
-      le.assoc_context[gcPosAdj] = 1;
+      mask |= grammeme_bit(gcPosAdj);
       for(size_t i = 1; i < msd.size(); ++i)
       {
-        if (i == 1 and msd[i] == 's') le.assoc_context[gcPossess] = 1;
-        if (i == 2) encodeDegree(msd[i], le);
-        if (i == 3) encodeGender(msd[i], le);
-        if (i == 4) encodeNumber(msd[i], le);
-        if (i == 5) encodeCase(msd[i], le);
-        if (i == 6) encodeDefiniteness(msd[i], le);
+        if (i == 1 and msd[i] == 's') mask |= grammeme_bit(gcPossess);
+        if (i == 2) encodeDegree(msd[i], mask);
+        if (i == 3) encodeGender(msd[i], mask);
+        if (i == 4) encodeNumber(msd[i], mask);
+        if (i == 5) encodeCase(msd[i], mask);
+        if (i == 6) encodeDefiniteness(msd[i], mask);
       }
     }
     if (msd[0] == 'P') // pronoun
     {
-      le.assoc_context[gcPosPron] = 1;
+      mask |= grammeme_bit(gcPosPron);
       for(size_t i = 1; i < msd.size(); ++i)
       {
         if (i == 1)
         {
           switch (msd[i])
           {
-          case 'p': le.assoc_context[gcPrntPers] = 1; break;
-          case 'd': le.assoc_context[gcPrntDem] = 1; break;
-          case 'i': le.assoc_context[gcPrntIndef] = 1; break;
-          case 's': le.assoc_context[gcPossess] = 1; break;
-          case 'q': le.assoc_context[gcPrntInterrog] = 1; break;
-          case 'r': le.assoc_context[gcPrntRelat] = 1; break;
-          case 'x': le.assoc_context[gcPrntReflex] = 1; break;
-          case 'z': le.assoc_context[gcPrntNeg] = 1; break;
-          case 'n': le.assoc_context[gcPrntNspec] = 1; break;
+          case 'p': mask |= grammeme_bit(gcPrntPers); break;
+          case 'd': mask |= grammeme_bit(gcPrntDem); break;
+          case 'i': mask |= grammeme_bit(gcPrntIndef); break;
+          case 's': mask |= grammeme_bit(gcPossess); break;
+          case 'q': mask |= grammeme_bit(gcPrntInterrog); break;
+          case 'r': mask |= grammeme_bit(gcPrntRelat); break;
+          case 'x': mask |= grammeme_bit(gcPrntReflex); break;
+          case 'z': mask |= grammeme_bit(gcPrntNeg); break;
+          case 'n': mask |= grammeme_bit(gcPrntNspec); break;
           }
         }
-        if (i == 2) encodePerson(msd[i], le);
-        if (i == 3) encodeGender(msd[i], le);
-        if (i == 4) encodeNumber(msd[i], le);
-        if (i == 5) encodeCase(msd[i], le);
+        if (i == 2) encodePerson(msd[i], mask);
+        if (i == 3) encodeGender(msd[i], mask);
+        if (i == 4) encodeNumber(msd[i], mask);
+        if (i == 5) encodeCase(msd[i], mask);
         if (i == 6)
         {
           switch (msd[i]) // todo: попробовать перекодировать в части речи
           {
-          case 'n': le.assoc_context[gcStNom] = 1; break;
-          case 'a': le.assoc_context[gcStAdj] = 1; break;
-          case 'r': le.assoc_context[gcStAdv] = 1; break;
+          case 'n': mask |= grammeme_bit(gcStNom); break;
+          case 'a': mask |= grammeme_bit(gcStAdj); break;
+          case 'r': mask |= grammeme_bit(gcStAdv); break;
           }
         }
-        if (i == 7) encodeAnim(msd[i], le);
+        if (i == 7) encodeAnim(msd[i], mask);
       }
     }
     if (msd[0] == 'R') // adverb
     {
-      le.assoc_context[gcPosAdv] = 1;
+      mask |= grammeme_bit(gcPosAdv);
       for(size_t i = 1; i < msd.size(); ++i)
       {
-        if (i == 1) encodeDegree(msd[i], le);
+        if (i == 1) encodeDegree(msd[i], mask);
       }
     }
     if (msd[0] == 'M') // numeral
     {
-      le.assoc_context[gcPosNumeral] = 1;
+      mask |= grammeme_bit(gcPosNumeral);
       for(size_t i = 1; i < msd.size(); ++i)
       {
         if (i == 1)
         {
           switch (msd[i])
           {
-          case 'c': le.assoc_context[gcNumeralCard] = 1; break;
-          case 'o': le.assoc_context[gcNumeralOrd] = 1; break;
-          case 'l': le.assoc_context[gcNumeralCollect] = 1; break;
+          case 'c': mask |= grammeme_bit(gcNumeralCard); break;
+          case 'o': mask |= grammeme_bit(gcNumeralOrd); break;
+          case 'l': mask |= grammeme_bit(gcNumeralCollect); break;
           }
         }
-        if (i == 2) encodeGender(msd[i], le);
-        if (i == 3) encodeNumber(msd[i], le);
-        if (i == 4) encodeCase(msd[i], le);
+        if (i == 2) encodeGender(msd[i], mask);
+        if (i == 3) encodeNumber(msd[i], mask);
+        if (i == 4) encodeCase(msd[i], mask);
       }
     }
     if (msd[0] == 'S') // adposition
     {
-      le.assoc_context[gcPosAdpos] = 1;
+      mask |= grammeme_bit(gcPosAdpos);
       for(size_t i = 1; i < msd.size(); ++i)
       {
-        if (i == 3) encodeCase(msd[i], le);
+        if (i == 3) encodeCase(msd[i], mask);
       }
     }
     if (msd[0] == 'C') // conjunction
     {
-      le.assoc_context[gcPosConj] = 1;
+      mask |= grammeme_bit(gcPosConj);
       for(size_t i = 1; i < msd.size(); ++i)
       {
         if (i == 1)
         {
           switch (msd[i])
           {
-          case 'c': le.assoc_context[gcCtCoord] = 1; break;
-          case 's': le.assoc_context[gcCtSubord] = 1; break;
+          case 'c': mask |= grammeme_bit(gcCtCoord); break;
+          case 's': mask |= grammeme_bit(gcCtSubord); break;
           }
         }
       }
     }
     if (msd[0] == 'Q') // particle
-      le.assoc_context[gcPosPart] = 1;
+      mask |= grammeme_bit(gcPosPart);
     if (msd[0] == 'I') // interjection
-      le.assoc_context[gcPosInter] = 1;
+      mask |= grammeme_bit(gcPosInter);
+    return mask;
   } // method-end
 }; // class-decl-end
 
@@ -0,0 +1,93 @@
+#ifndef MMAP_MATRIX_H_
+#define MMAP_MATRIX_H_
+
+#include <string>
+#include <cstring>       // for std::strerror
+#include <cerrno>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+
+#ifndef _MSC_VER
+  #include <sys/mman.h>
+  #include <sys/types.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+
+// Размещение весовой матрицы в отображаемом в память файле (для обучения моделей, не помещающихся в оперативную память).
+// Файл создаётся разреженным (страницы не занимают места до первой записи), отображение разделяемое (MAP_SHARED),
+// поэтому при нехватке памяти ядро сбрасывает страницы в сам файл, а не в swap.
+// Строки матриц упорядочены по убыванию частоты слов, поэтому "горячая" часть -- это префикс отображения.
+class MmapMatrix
+{
+public:
+  // поддерживается ли отображение файлов на данной платформе
+  static bool is_supported()
+  {
+#ifndef _MSC_VER
+    return true;
+#else
+    return false;
+#endif
+  }
+  // создание файла заданного размера и его отображение в память (содержимое заполнено нулями)
+  static float* create(const std::string& filename, size_t bytes)
+  {
+#ifndef _MSC_VER
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+      std::cerr << "MmapMatrix error: " << filename << ": " << std::strerror(errno) << std::endl;
+      return nullptr;
+    }
+    if ( ftruncate(fd, bytes) != 0 )
+    {
+      std::cerr << "MmapMatrix error: " << filename << ": " << std::strerror(errno) << std::endl;
+      close(fd);
+      return nullptr;
+    }
+    void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // отображение остаётся действительным и после закрытия дескриптора
+    if (ptr == MAP_FAILED)
+    {
+      std::cerr << "MmapMatrix error: " << filename << ": " << std::strerror(errno) << std::endl;
+      return nullptr;
+    }
+    return reinterpret_cast<float*>(ptr);
+#else
+    std::cerr << "MmapMatrix: memory mapped matrices are not supported on this platform" << std::endl;
+    return nullptr;
+#endif
+  } // method-end
+  // подсказки ядру о характере доступа: обращения к строкам случайны (упреждающее чтение бесполезно),
+  // а префикс частотных строк желательно держать в памяти
+  static void advise(float* ptr, size_t bytes, size_t hot_bytes)
+  {
+#ifndef _MSC_VER
+    madvise(ptr, bytes, MADV_RANDOM);
+    if (hot_bytes > 0)
+      madvise(ptr, std::min(hot_bytes, bytes), MADV_WILLNEED);
+#endif
+  } // method-end
+  // подсказка перед последовательным проходом по матрице (например, сохранением модели)
+  static void advise_sequential(float* ptr, size_t bytes)
+  {
+#ifndef _MSC_VER
+    madvise(ptr, bytes, MADV_SEQUENTIAL);
+#endif
+  } // method-end
+  // освобождение отображения и удаление файла (файл -- только хранилище матрицы на время обучения, модель сохраняется отдельно;
+  // файл удаляется до снятия отображения, поэтому изменённые страницы в него уже не сбрасываются)
+  static void release(float* ptr, size_t bytes, const std::string& filename)
+  {
+#ifndef _MSC_VER
+    std::remove(filename.c_str());
+    munmap(ptr, bytes);
+#endif
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* MMAP_MATRIX_H_ */
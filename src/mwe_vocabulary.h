@@ -219,6 +219,16 @@ public:
     }
 
   } // method-end
+  // есть ли в предложении леммы, являющиеся вершинами словосочетаний (если нет, put_phrases_into_sentence не меняет предложение)
+  bool has_candidates(const std::vector< std::vector<std::string> >& sentence_matrix) const
+  {
+    if ( mwes.empty() )
+      return false;
+    for (auto& token : sentence_matrix)
+      if ( mwes.find(token[Conll::LEMMA]) != mwes.end() )
+        return true;
+    return false;
+  } // method-end
   // вспомогательный метод для incorporate_phrases_to_sentence
   // строит отображение из индекса токена предложения в список фраз-кандидатов
   void ph2s_search_candidates(const std::vector< std::vector<std::string> >& sentence_matrix, std::map< size_t, std::vector< std::shared_ptr<Phrase> > >& phCandidates) const
@@ -76,6 +76,20 @@ public:
     vocabulary_hash[word] = vocabulary.size();
     CustomVocabulary::append(word, cn);
   }
+  // дополнение словаря словами векторной модели, которых в нём нет (например, при дообучении модели на новых данных)
+  // дополняемые слова получают заданную частоту и размещаются в конце словаря
+  size_t append_missing(const VectorsModel& vm, uint64_t cn = 1)
+  {
+    size_t appended = 0;
+    for (auto& word : vm.vocab)
+    {
+      if ( vocabulary_hash.find(word) != vocabulary_hash.end() )
+        continue;
+      append(word, cn);
+      ++appended;
+    }
+    return appended;
+  }
   // инициализация списка стоп-слов
   void init_stoplist(const std::string& stopwords_filename)
   {
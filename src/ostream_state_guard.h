@@ -0,0 +1,32 @@
+#ifndef OSTREAM_STATE_GUARD_H_
+#define OSTREAM_STATE_GUARD_H_
+
+#include <ios>
+
+
+// Восстановление флагов форматирования и точности потока при выходе из области видимости
+// (отчеты, использующие std::fixed и std::setprecision, не должны влиять на последующий вывод, например, SimpleProfiler)
+class OstreamStateGuard
+{
+public:
+  explicit OstreamStateGuard(std::ios_base& stream)
+  : os(stream)
+  , saved_flags(stream.flags())
+  , saved_precision(stream.precision())
+  {
+  }
+  ~OstreamStateGuard()
+  {
+    os.flags(saved_flags);
+    os.precision(saved_precision);
+  }
+  OstreamStateGuard(const OstreamStateGuard&) = delete;
+  OstreamStateGuard& operator=(const OstreamStateGuard&) = delete;
+private:
+  std::ios_base& os;
+  std::ios_base::fmtflags saved_flags;
+  std::streamsize saved_precision;
+}; // class-decl-end
+
+
+#endif /* OSTREAM_STATE_GUARD_H_ */
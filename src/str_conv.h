@@ -6,7 +6,8 @@
 #include <codecvt>
 #include <unicode/uchar.h>
 #include <vector>
-#include <regex>
+#include <cctype>
+#include <algorithm>
 
 
 class StrConv
@@ -89,11 +90,25 @@ public:
     }
   } // method-end
   // деление строки на подстроки по space-последовательностям
+  // (семантика разбиения по регулярному выражению \s+: начальные пробелы дают пустую первую подстроку, конечные -- игнорируются)
   static void split_by_whitespaces(const std::string& str, std::vector<std::string>& result)
   {
-    const std::regex space_re("\\s+");
-    result = std::vector<std::string>( std::sregex_token_iterator(str.cbegin(), str.cend(), space_re, -1),
-                                       std::sregex_token_iterator() );
+    result.clear();
+    const size_t len = str.size();
+    size_t pos = 0;
+    while (true)
+    {
+      size_t end = pos;
+      while ( end < len && !std::isspace(static_cast<unsigned char>(str[end])) )
+        ++end;
+      if ( end > pos || end < len || result.empty() )
+        result.emplace_back(str, pos, end - pos);
+      if ( end == len )
+        break;
+      pos = end;
+      while ( pos < len && std::isspace(static_cast<unsigned char>(str[pos])) )
+        ++pos;
+    }
   } // method-end
 };
 
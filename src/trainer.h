@@ -6,15 +6,23 @@
 #include "original_word2vec_vocabulary.h"
 #include "vectors_model.h"
 #include "special_toks.h"
+#include "mmap_matrix.h"
+#include "distributed_sync.h"
+#include "fast_sigmoid.h"
+#include "counter_rng.h"
+#include "conflict_sampler.h"
 
 #include <memory>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <chrono>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <condition_variable>
+#include <thread>
+#include <atomic>
 
 #include "log.h"
 
@@ -47,6 +55,7 @@ class ThreadsInWorkCounterGuard;
 class Trainer
 {
   friend class ThreadsInWorkCounterGuard;
+  friend class TrainersGroup;
 public:
   // конструктор
   Trainer( std::shared_ptr< LearningExampleProvider> learning_example_provider,
@@ -64,7 +73,8 @@ public:
            float lr_inflection,
            size_t negative_count_d,
            size_t negative_count_a,
-           size_t total_threads_count )
+           size_t total_threads_count,
+           size_t noise_table_size = NOISE_TABLE_SIZE )
   : lep(learning_example_provider)
   , w_vocabulary(words_vocabulary)
   , w_vocabulary_size(words_vocabulary->size())
@@ -85,6 +95,7 @@ public:
   , inflection_point(lr_inflection)
   , negative_d(negative_count_d)
   , negative_a(negative_count_a)
+  , table_size(noise_table_size)
   {
     // предварительный табличный расчет для логистической функции
     expTable = (float *)malloc((EXP_TABLE_SIZE + 1) * sizeof(float));
@@ -111,75 +122,92 @@ public:
   {
     free(expTable);
     if (syn0)
-      free_aligned(syn0);
+      free_matrix(syn0, syn0_mmap_bytes, ".syn0");
     if (syn1_dep)
-      free_aligned(syn1_dep);
+      free_matrix(syn1_dep, syn1_dep_mmap_bytes, ".syn1_dep");
     if (syn1_assoc)
       free_aligned(syn1_assoc);
     if (table_dep)
       free(table_dep);
   }
+  // размещение весовых матриц в отображаемых в память файлах <prefix>.syn0 и <prefix>.syn1_dep (вызывается до create_net)
+  // файлы удаляются вместе с матрицами (в деструкторе)
+  void set_mmap_storage(const std::string& prefix)
+  {
+    mmap_prefix = prefix;
+  } // method-end
   // функция создания весовых матриц нейросети
   void create_net()
   {
-    long long ap = 0;
-
     size_t w_vocab_size = w_vocabulary->size();
-    ap = posix_memalign((void **)&syn0, 128, (long long)w_vocab_size * layer1_size * sizeof(float));
-    if (syn0 == nullptr || ap != 0) {std::cerr << "Memory allocation failed" << std::endl; exit(1);}
+    syn0 = alloc_matrix(w_vocab_size, layer1_size, ".syn0", syn0_mmap_bytes);
 
     if ( dep_ctx_vocabulary )
     {
-      size_t dep_vocab_size = dep_ctx_vocabulary->size();
-      ap = posix_memalign((void **)&syn1_dep, 128, (long long)dep_vocab_size * size_dep * sizeof(float));
-      if (syn1_dep == nullptr || ap != 0) {std::cerr << "Memory allocation failed" << std::endl; exit(1);}
+      syn1_dep = alloc_matrix(dep_rows(), size_dep, ".syn1_dep", syn1_dep_mmap_bytes);
     }
   } // method-end
+  // подготовка к сохранению модели: далее ожидается последовательный проход по матрицам, размещенным в отображаемой памяти
+  // (отдельный сброс страниц в файлы не нужен -- модель читается из отображения при сохранении)
+  void prepare_saving()
+  {
+    if (syn0_mmap_bytes)
+      MmapMatrix::advise_sequential(syn0, syn0_mmap_bytes);
+    if (syn1_dep_mmap_bytes)
+      MmapMatrix::advise_sequential(syn1_dep, syn1_dep_mmap_bytes);
+  } // method-end
   // функция инициализации нейросети
   void init_net()
   {
-    unsigned long long next_random = 1;
     size_t w_vocab_size = w_vocabulary->size();
-//    for (size_t a = 0; a < w_vocab_size; ++a)
-//      for (size_t b = 0; b < layer1_size; ++b)
-//      {
-//        next_random = next_random * (unsigned long long)25214903917 + 11;
-//        syn0[a * layer1_size + b] = (((next_random & 0xFFFF) / (float)65536) - 0.5) / layer1_size;
-//      }
-    for (size_t a = 0; a < w_vocab_size; ++a)
+    // строки заполняются параллельно (каждый поток первым касается своих страниц памяти);
+    // случайные величины берутся из генератора на основе счетчика (строка, измерение), поэтому не зависят от числа потоков
+    parallel_rows(w_vocab_size, [this](size_t from, size_t to)
     {
-      //float denominator = std::sqrt(w_vocabulary->idx_to_data(a).cn);
-      float denominator = std::log( w_vocabulary->idx_to_data(a).cn + 3 );
-      for (size_t b = 0; b < layer1_size; ++b)
+      for (size_t a = from; a < to; ++a)
       {
-        next_random = next_random * (unsigned long long)25214903917 + 11;
-        //syn0[a * layer1_size + b] = (((next_random & 0xFFFF) / (float)65536) - 0.5) / denominator; // более частотные ближе к нулю
-        syn0[a * layer1_size + b] = (((next_random & 0xFFFF) / (float)65536) - 0.5) / layer1_size / denominator; // более частотные ближе к нулю
+        //float denominator = std::sqrt(w_vocabulary->idx_to_data(a).cn);
+        float denominator = std::log( w_vocabulary->idx_to_data(a).cn + 3 );
+        float *row = syn0 + a * layer1_size;
+        CounterRng::uniform_row(INIT_RNG_KEY, a, row, layer1_size);
+        for (size_t b = 0; b < layer1_size; ++b)
+          row[b] = (row[b] - 0.5) / layer1_size / denominator; // более частотные ближе к нулю
       }
-    }
+    });
 
-    if ( dep_ctx_vocabulary )
+    if ( dep_ctx_vocabulary && syn1_dep_mmap_bytes == 0 ) // свежесозданный файл отображения уже заполнен нулями (не трогаем страницы)
     {
-      size_t dep_vocab_size = dep_ctx_vocabulary->size();
-      std::fill(syn1_dep, syn1_dep+dep_vocab_size*size_dep, 0.0);
+      parallel_rows(dep_rows(), [this](size_t from, size_t to)
+      {
+        std::fill(syn1_dep + from * size_dep, syn1_dep + to * size_dep, 0.0);
+      });
     }
 
+    // подсказки ядру: префикс частотных строк держим в памяти
+    if (syn0_mmap_bytes)
+      MmapMatrix::advise(syn0, syn0_mmap_bytes, hot_rows_count(w_vocabulary) * layer1_size * sizeof(float));
+    if (syn1_dep_mmap_bytes)
+      MmapMatrix::advise(syn1_dep, syn1_dep_mmap_bytes, std::min(hot_rows_count(dep_ctx_vocabulary), dep_rows()) * size_dep * sizeof(float));
+
     start_learning_tp = std::chrono::steady_clock::now();
   } // method-end
   void create_and_init_gramm_net()
   {
     long long ap = 0;
-    unsigned long long next_random = 1;
 
     size_t w_vocab_size = w_vocabulary->size();
     ap = posix_memalign((void **)&syn0, 128, (long long)w_vocab_size * size_gramm * sizeof(float));
     if (syn0 == nullptr || ap != 0) {std::cerr << "Memory allocation failed" << std::endl; exit(1);}
-    for (size_t a = 0; a < w_vocab_size; ++a)
-      for (size_t b = 0; b < size_gramm; ++b)
+    parallel_rows(w_vocab_size, [this](size_t from, size_t to)
+    {
+      for (size_t a = from; a < to; ++a)
       {
-        next_random = next_random * (unsigned long long)25214903917 + 11;
-        syn0[a * size_gramm + b] = (((next_random & 0xFFFF) / (float)65536) - 0.5) / 100;
+        float *row = syn0 + a * size_gramm;
+        CounterRng::uniform_row(INIT_RNG_KEY, a, row, size_gramm);
+        for (size_t b = 0; b < size_gramm; ++b)
+          row[b] = (row[b] - 0.5) / 100;
       }
+    });
 
     size_t output_size = lep->getGrammemesVectorSize();
     ap = posix_memalign((void **)&syn1_assoc, 128, (long long)output_size * size_gramm * sizeof(float));
@@ -194,8 +222,14 @@ public:
     std::unique_ptr<ThreadsInWorkCounterGuard> wth_guard = std::make_unique<ThreadsInWorkCounterGuard>(this);
 
     unsigned long long next_random_ns = thread_idx;
+    if ( dist ) // потоки разных узлов должны получать разные псевдослучайные последовательности
+      next_random_ns += dist->get_rank() * lep->get_threads_count();
     // выделение памяти для хранения величины ошибки
     float *neu1e = (float *)calloc(layer1_size, sizeof(float));
+    // буфер регистрации обновлений строк (при измерении конфликтов записи)
+    conflict_ring = conflicts ? conflicts->ring(thread_idx) : nullptr;
+    // количество обработанных потоком обучающих примеров (для темпирования выделенных исполнителей внешних словарей)
+    uint64_t examples_done = 0;
     // цикл по эпохам
     for (size_t epochIdx = 0; epochIdx < epoch_count; ++epochIdx)
     {
@@ -209,26 +243,16 @@ public:
         // и корректировка коэффициента скорости обучения (alpha)
         if (word_count - last_word_count > alpha_chunk)
         {
-          word_count_actual += (word_count - last_word_count);
+          update_progress(word_count - last_word_count);
           last_word_count = word_count;
-          fraction = word_count_actual / (float)(epoch_count * train_words + 1);
-          //if ( debug_mode != 0 )
-          {
-            std::chrono::steady_clock::time_point current_learning_tp = std::chrono::steady_clock::now();
-            std::chrono::duration< double, std::ratio<1> > learning_seconds = current_learning_tp - start_learning_tp;
-            printf( "\rAlpha: %f / %f     Progress: %.2f%%  Words/sec: %.2fk        ", alpha_d, alpha_a,
-                    fraction * 100,
-                    word_count_actual / (learning_seconds.count() * 1000) );
-            fflush(stdout);
-          }
-          alpha_d = alpha_upd(starting_alpha_d);
-          alpha_a = alpha_upd(starting_alpha_a);
-          if (dep_se_cnt >= 1000000)
+          // при распределенном обучении решение о масштабировании принимается согласованно в раунде синхронизации
+          if (dep_se_cnt >= 1000000 && !dist)
             do_sync_action(thread_idx, &Trainer::rescale_dep);
-          if (ass_se_cnt >= 1000000)
+          if (ass_se_cnt >= 1000000 && !dist)
             do_sync_action(thread_idx, &Trainer::rescale_assoc);
-          //if ((upd_ss_cnt == 0 && fraction >= 0.25) || (upd_ss_cnt == 1 && fraction >= 0.5) || (upd_ss_cnt == 2 && fraction >= 0.75))
-          if ((upd_ss_cnt == 0 && fraction >= 0.40) || (upd_ss_cnt == 1 && fraction >= 0.60) || (upd_ss_cnt == 2 && fraction >= 0.80))
+          if ( dist && words_since_sync >= dist->get_sync_words() )
+            do_sync_action(thread_idx, &Trainer::distributed_sync);
+          if ( is_subsampling_checkpoint() )
             do_sync_action(thread_idx, &Trainer::decrease_subsampling);
           // if ( (dbg_show_dims_cnt == 0  && fraction >= 0.05) || 
           //      (dbg_show_dims_cnt == 1  && fraction >= 0.1)  || 
@@ -257,9 +281,14 @@ public:
         word_count = lep->getWordsCount(thread_idx);
         if (!learning_example) break; // признак окончания эпохи (все обучающие примеры перебраны)
         // используем обучающий пример для обучения нейросети
+        if ( conflict_ring )
+          conflict_ring->begin_example();
         skip_gram( learning_example.value(), neu1e, next_random_ns );
+        // счетчик пишется только этим потоком и лежит в собственной кэш-линии
+        if ( ext_vocabs )
+          ext_examples_done[thread_idx].value.store(++examples_done, std::memory_order_relaxed);
       } // for all learning examples
-      word_count_actual += (word_count - last_word_count);
+      count_words(word_count - last_word_count);
       if ( !lep->epoch_unprepare(thread_idx) )
         return;
     } // for all epochs
@@ -268,11 +297,9 @@ public:
   // процедура обучения грамматического вектора (точка входа для потоков)
   void train_entry_point__gramm( size_t thread_idx )
   {
-    // выделение памяти для хранения выхода нейросети и дельт нейронов
-    size_t output_size = lep->getGrammemesVectorSize();
-    float *y = (float *)calloc(output_size, sizeof(float));
-    float *eo = (float *)calloc(output_size, sizeof(float));
-    float *eh = (float *)calloc(size_gramm, sizeof(float));
+    // рабочие матрицы мини-пакета обучающих примеров
+    GrammBatch batch( lep->getGrammemesVectorSize(), size_gramm );
+    size_t batch_size = 0;
     // цикл по эпохам
     for (size_t epochIdx = 0; epochIdx < epoch_count; ++epochIdx)
     {
@@ -286,62 +313,111 @@ public:
         // и корректировка коэффициента скорости обучения (alpha)
         if (word_count - last_word_count > alpha_chunk)
         {
-          word_count_actual += (word_count - last_word_count);
+          update_progress__gramm(word_count - last_word_count, epoch_count * train_words);
           last_word_count = word_count;
-          fraction = word_count_actual / (float)(epoch_count * train_words + 1);
-          //if ( debug_mode != 0 )
-          {
-            std::chrono::steady_clock::time_point current_learning_tp = std::chrono::steady_clock::now();
-            std::chrono::duration< double, std::ratio<1> > learning_seconds = current_learning_tp - start_learning_tp;
-            printf( "\rAlpha: %f  Progress: %.2f%%  Words/sec: %.2fk   ", alpha_g,
-                    fraction * 100,
-                    word_count_actual / (learning_seconds.count() * 1000) );
-            fflush(stdout);
-          }
-          alpha_g = starting_alpha_g * (1.0 - fraction);
-          if ( alpha_g < starting_alpha_g * 0.0001 )
-            alpha_g = starting_alpha_g * 0.0001;
         } // if ('checkpoint')
         // читаем очередной обучающий пример
         auto learning_example = lep->get(thread_idx, fraction, true);
         word_count = lep->getWordsCount(thread_idx);
         if (!learning_example) break; // признак окончания эпохи (все обучающие примеры перебраны)
-        // используем обучающий пример для обучения нейросети
-
-        // прямой проход
-        float* wordVectorPtr= syn0 + learning_example->word * size_gramm;
-        for (size_t g = 0; g < output_size; ++g)
+        // накапливаем обучающие примеры в мини-пакет и обучаем нейросеть на пакете целиком
+        batch.words[batch_size] = learning_example->word;
+        batch.targets[batch_size] = learning_example->grammemes;
+        if (++batch_size == GRAMM_BATCH_SIZE)
         {
-          float* offs = syn1_assoc + g  * size_gramm;
-          y[g] = sigmoid( std::inner_product(wordVectorPtr, wordVectorPtr+size_gramm, offs, 0.0) );
+          gramm_train_batch(batch, batch_size);
+          batch_size = 0;
         }
-        //softmax(y, output_size);
-
-        // обратный проход
-        std::fill(eh, eh+size_gramm, 0.0);
-        //float tSum = std::accumulate(learning_example->assoc_context.begin(), learning_example->assoc_context.end(), 0);
-        std::transform(learning_example->assoc_context.begin(), learning_example->assoc_context.end(), y, eo, [this](float a, float b) -> float {return (a - b) * alpha_g;});
-        // преобразуем вторую матрицу и попутно копим дельты для скрытого слоя
-        for (size_t g = 0; g < output_size; ++g)
-          for (size_t i = 0; i < size_gramm; ++i)
-          {
-            eh[i] += syn1_assoc[g*size_gramm+i] * eo[g];
-            syn1_assoc[g*size_gramm+i] += wordVectorPtr[i] * eo[g];
-          }
-        // преобразуем первую матрицу
-        std::transform(wordVectorPtr, wordVectorPtr+size_gramm, eh, wordVectorPtr, std::plus<float>());
-        // ограничение степени выраженности признака
-        std::transform(wordVectorPtr, wordVectorPtr+size_gramm, wordVectorPtr, Trainer::space_threshold_functor);
-
       } // for all learning examples
+      if (batch_size > 0)
+      {
+        gramm_train_batch(batch, batch_size);
+        batch_size = 0;
+      }
       word_count_actual += (word_count - last_word_count);
       if ( !lep->epoch_unprepare(thread_idx) )
         return;
     } // for all epochs
-    free(y);
-    free(eo);
-    free(eh);
   } // method-end: train_entry_point__gramm
+  // построение дедуплицированной таблицы обучающих примеров для грамматических векторов:
+  // примеры зависят только от пары (слово, граммемы), поэтому корпус читается один раз (параллельно),
+  // а далее обучение ведется на выборке из таблицы пропорционально частотам пар
+  void build_gramm_table()
+  {
+    const size_t threads_count = lep->get_threads_count();
+    std::vector<GrammCounts> partial(threads_count);
+    lep->set_gramm_subsampling(false);
+    std::vector<std::thread> threads_vec;
+    threads_vec.reserve(threads_count);
+    for (size_t i = 0; i < threads_count; ++i)
+      threads_vec.emplace_back(&Trainer::collect_entry_point__gramm, this, i, std::ref(partial[i]));
+    for (size_t i = 0; i < threads_count; ++i)
+      threads_vec[i].join();
+    lep->set_gramm_subsampling(true);
+    // слияние частичных таблиц
+    for (size_t i = 1; i < threads_count; ++i)
+    {
+      for (auto& r : partial[i])
+        partial[0][r.first] += r.second;
+      GrammCounts().swap(partial[i]);
+    }
+    gramm_table.clear();
+    gramm_table.reserve(partial[0].size());
+    uint64_t occurrences = 0;
+    for (auto& r : partial[0])
+    {
+      gramm_table.push_back( {r.first.first, r.first.second, r.second} );
+      occurrences += r.second;
+    }
+    GrammCounts().swap(partial[0]);
+    std::sort(gramm_table.begin(), gramm_table.end(), [](const GrammExample& a, const GrammExample& b) { return std::tie(a.word, a.grammemes) < std::tie(b.word, b.grammemes); });
+    // веса выборки учитывают сэмплирование частотных слов (ожидаемое число примеров, попавших бы в обучение при чтении корпуса)
+    gramm_table_cdf.resize(gramm_table.size());
+    double total_weight = 0;
+    for (size_t i = 0; i < gramm_table.size(); ++i)
+    {
+      total_weight += gramm_table[i].cn * w_vocabulary->idx_to_data(gramm_table[i].word).sample_probability;
+      gramm_table_cdf[i] = total_weight;
+    }
+    gramm_steps_total = static_cast<uint64_t>(total_weight) * epoch_count;
+    std::cout << "Grammatical examples: " << occurrences << " occurrences, " << gramm_table.size() << " unique ("
+              << std::setprecision(3) << (occurrences ? 100.0 * gramm_table.size() / occurrences : 0.0) << "%)" << std::setprecision(6) << std::endl;
+    start_learning_tp = std::chrono::steady_clock::now();
+  } // method-end
+  // процедура обучения грамматического вектора по дедуплицированной таблице примеров (точка входа для потоков)
+  void train_entry_point__gramm_table( size_t thread_idx )
+  {
+    if ( gramm_table.empty() )
+      return;
+    const size_t threads_count = lep->get_threads_count();
+    const uint64_t steps = gramm_steps_total / threads_count + ( (thread_idx < gramm_steps_total % threads_count) ? 1 : 0 );
+    const double total_weight = gramm_table_cdf.back();
+    unsigned long long next_random_ns = thread_idx;
+    GrammBatch batch( lep->getGrammemesVectorSize(), size_gramm );
+    uint64_t step = 0, last_step = 0;
+    while (step < steps)
+    {
+      if (step - last_step > static_cast<uint64_t>(alpha_chunk))
+      {
+        update_progress__gramm(step - last_step, gramm_steps_total);
+        last_step = step;
+      }
+      // выборка примеров пропорционально весам
+      const size_t n = std::min<uint64_t>(GRAMM_BATCH_SIZE, steps - step);
+      for (size_t b = 0; b < n; ++b)
+      {
+        update_random_ns(next_random_ns);
+        const double r = (next_random_ns >> 16) / 281474976710656.0 * total_weight; // 2^48
+        size_t idx = std::upper_bound(gramm_table_cdf.begin(), gramm_table_cdf.end(), r) - gramm_table_cdf.begin();
+        if (idx >= gramm_table.size()) idx = gramm_table.size() - 1;
+        batch.words[b] = gramm_table[idx].word;
+        batch.targets[b] = gramm_table[idx].grammemes;
+      }
+      gramm_train_batch(batch, n);
+      step += n;
+    }
+    word_count_actual += (step - last_step);
+  } // method-end
   void saveGrammaticalEmbeddings(const VectorsModel& vm, float g_ratio, const std::string& oov_voc_fn, const std::string& filename) const
   {
     const size_t INVALID_IDX = std::numeric_limits<size_t>::max();
@@ -485,6 +561,54 @@ public:
     saveEmbeddingsBin_helper(fo, w_vocabulary, syn0, layer1_size);
     fclose(fo);
   } // method-end
+  // отслеживание строк syn0, измененных при обучении (вызывается до начала обучения; используется для сохранения дельты)
+  void track_touched_rows()
+  {
+    touched_rows.assign(w_vocabulary->size(), 0);
+  } // method-end
+  // сохранение дельты относительно исходной модели: только строки, изменившиеся при доучивании словоформ, и только в
+  // категориальном подпространстве (ассоциативная часть при доучивании токенов заморожена); применяется задачей apply_delta
+  // в дельту записывается и итоговый состав строк модели в порядке saveEmbeddings (специальные токены, затем словарь
+  // словоформ), поэтому наложение дельты дает ту же модель, что и сохранение без -delta
+  bool saveDelta(const std::string& filename, const VectorsModel& vm) const
+  {
+    std::unordered_map<std::string, size_t> index;
+    index.reserve(vm.vocab.size());
+    for (size_t idx = 0; idx < vm.vocab.size(); ++idx)
+      index.emplace(vm.vocab[idx], idx);
+    std::vector<size_t> changed;
+    for (size_t a = 0; a < touched_rows.size(); ++a)
+    {
+      if ( !touched_rows[a] )
+        continue;
+      auto it = index.find( w_vocabulary->idx_to_data(a).word );
+      const float* trained = syn0 + a * layer1_size;
+      if ( it != index.end() && std::equal(trained, trained + size_dep, vm.embeddings + it->second * vm.emb_size) )
+        continue;
+      changed.push_back(a);
+    }
+    FILE *fo = fopen(filename.c_str(), "wb");
+    if ( !fo )
+    {
+      std::cerr << "Can't create delta file: " << filename << std::endl;
+      return false;
+    }
+    std::vector<std::string> order;
+    order.reserve(w_vocabulary->size() + SPECIAL_TOKS.size());
+    for ( auto w : SPECIAL_TOKS )
+      if ( index.find(w) != index.end() )
+        order.push_back(w);
+    for (size_t a = 0; a < w_vocabulary->size(); ++a)
+      order.push_back( w_vocabulary->idx_to_data(a).word );
+    fprintf(fo, "%lu %lu %lu %lu %lu %lu %lu %lu\n", changed.size(), layer1_size, size_dep, size_assoc, size_gramm, 0UL, size_dep, order.size());
+    for (auto& w : order)
+      fprintf(fo, "%s\n", w.c_str());
+    for (auto a : changed)
+      VectorsModel::write_embedding_slice(fo, w_vocabulary->idx_to_data(a).word, syn0 + a * layer1_size, 0, size_dep);
+    fclose(fo);
+    std::cout << "Delta saved: " << changed.size() << " of " << w_vocabulary->size() << " rows changed" << std::endl;
+    return true;
+  } // method-end
   // функция сохранения весовых матриц в файл
   void backup(const std::string& filename, bool left = true, bool right= true) const
   {
@@ -553,21 +677,219 @@ public:
       std::cerr << "restore_left_matrix: dimensions discrepancy" << std::endl;
       return false;
     }
+    // индекс словаря модели (линейный поиск по vm.vocab для каждого слова слишком дорог на больших словарях)
+    std::unordered_map<std::string, size_t> vm_index;
+    vm_index.reserve(vm.vocab.size());
+    for (size_t i = 0; i < vm.vocab.size(); ++i)
+      vm_index.emplace(vm.vocab[i], i);
+    size_t restored = 0;
     for (size_t w = 0; w < w_vocabulary->size(); ++w)
     {
       auto& voc_rec = w_vocabulary->idx_to_data(w);
-      size_t vm_idx = vm.get_word_idx( voc_rec.word );
-      if (vm_idx == vm.words_count) // вектора неизвестных слов остаются случайно-инициализированными
+      auto vm_it = vm_index.find( voc_rec.word );
+      if (vm_it == vm_index.end()) // вектора неизвестных слов остаются случайно-инициализированными
       {
         //std::cerr << "warning: vector representation random init: " << voc_rec.word << std::endl;
         continue;
       }
       float* hereOffset  = syn0 + w * layer1_size;
-      float* thereOffset = vm.embeddings + vm_idx * vm.emb_size;
+      float* thereOffset = vm.embeddings + vm_it->second * vm.emb_size;
       std::copy(thereOffset, thereOffset + vm.emb_size, hereOffset);
+      ++restored;
+    }
+    std::cout << "Left matrix restored by model: " << restored << " rows, new (random init): " << (w_vocabulary->size() - restored) << std::endl;
+    return true;
+  } // method-end
+  // функция восстановления правой весовой матрицы из резервной копии с сопоставлением строк по словам
+  // используется при дообучении, когда словарь контекстов изменился (в отличие от restore, не требует совпадения словарей);
+  // строки новых контекстов сохраняют начальную инициализацию, контексты, выпавшие из словаря, отбрасываются
+  bool restore_right_matrix_by_words(const std::string& filename)
+  {
+    const size_t INVALID_IDX = std::numeric_limits<size_t>::max();
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    if ( !ifs.good() )
+    {
+      std::cerr << "Restore: Backup file not found" << std::endl;
+      return false;
+    }
+    size_t vocab_size, emb_size;
+    restore__read_sizes(ifs, vocab_size, emb_size);
+    if (emb_size != size_dep)
+    {
+      std::cerr << "Restore: Dimensions fail" << std::endl;
+      return false;
+    }
+    std::vector<float> row(emb_size);
+    std::string word, buf;
+    size_t restored = 0;
+    for (size_t i = 0; i < vocab_size; ++i)
+    {
+      std::getline(ifs, word, ' '); // читаем слово (до пробела)
+      ifs.read( reinterpret_cast<char*>( row.data() ), sizeof(float)*emb_size );
+      std::getline(ifs,buf); // считываем конец строки
+      if ( !ifs.good() )
+      {
+        std::cerr << "Restore: Unexpected end of backup file" << std::endl;
+        return false;
+      }
+      size_t idx = dep_ctx_vocabulary->word_to_idx(word);
+      if (idx == INVALID_IDX)
+        continue;
+      std::copy(row.begin(), row.end(), syn1_dep + idx * size_dep);
+      ++restored;
+    }
+    std::cout << "Right matrix restored by words: " << restored << " rows, new: " << (dep_ctx_vocabulary->size() - restored) << std::endl;
+    start_learning_tp = std::chrono::steady_clock::now();
+    return true;
+  } // method-end
+  // учет прогресса обучения (в контрольной точке) и пересчет коэффициентов скорости обучения
+  void update_progress(long long words_delta, bool verbose = true)
+  {
+    count_words(words_delta);
+    fraction = word_count_actual / (float)(epoch_count * train_words + 1);
+    if ( verbose )
+    {
+      std::chrono::steady_clock::time_point current_learning_tp = std::chrono::steady_clock::now();
+      std::chrono::duration< double, std::ratio<1> > learning_seconds = current_learning_tp - start_learning_tp;
+      printf( "\rAlpha: %f / %f     Progress: %.2f%%  Words/sec: %.2fk        ", alpha_d, alpha_a,
+              fraction * 100,
+              word_count_actual / (learning_seconds.count() * 1000) );
+      fflush(stdout);
     }
+    alpha_d = alpha_upd(starting_alpha_d);
+    alpha_a = alpha_upd(starting_alpha_a);
+  } // method-end
+  // включение распределенного обучения (вызывается после инициализации нейросети); узел обучается на своей части корпуса,
+  // весовые матрицы периодически усредняются между узлами, начальное состояние берется у ведущего узла
+  bool set_distributed(std::shared_ptr<DistributedSync> ds)
+  {
+    if ( !ds->connect() )
+      return false;
+    dist_touched_syn0 = ds->attach(syn0, w_vocabulary->size(), layer1_size);
+    if ( dep_ctx_vocabulary )
+      dist_touched_syn1_dep = ds->attach(syn1_dep, dep_rows(), size_dep);
+    if ( !ds->start() )
+      return false;
+    lep->set_shard(ds->get_rank(), ds->get_nodes_count());
+    dist = ds;
+    start_learning_tp = std::chrono::steady_clock::now();
     return true;
   } // method-end
+  // завершение распределенного обучения (вызывается после завершения всех потоков):
+  // узел участвует в раундах синхронизации, пока обучение не завершат все узлы
+  bool distributed_finish()
+  {
+    if ( !dist )
+      return true;
+    DistributedSync::RoundResult result;
+    do
+    {
+      if ( !distributed_round(true, result) )
+        return false;
+    } while ( !result.all_finished );
+    std::cout << std::endl << "Distributed training finished, global words processed: " << result.global_words << std::endl;
+    return true;
+  } // method-end
+  // включение адаптивной (AdaGrad) скорости обучения для строк весовых матриц (вызывается после create_net)
+  // для каждой строки syn0 хранится по накопителю на каждое подпространство (категориальное и ассоциативное), для syn1_dep -- один
+  void enable_adagrad()
+  {
+    adagrad = true;
+    ada_syn0.assign(w_vocabulary->size() * 2, ADAGRAD_INITIAL_ACC);
+    if ( dep_ctx_vocabulary )
+      ada_syn1_dep.assign(dep_rows(), ADAGRAD_INITIAL_ACC);
+  } // method-end
+  // иерархический softmax для синтаксической части (вызывается до create_net):
+  // вместо отрицательных примеров обновляются вектора внутренних узлов дерева Хаффмана на пути к контексту (O(log V) на контекст),
+  // строки syn1_dep в этом режиме соответствуют внутренним узлам, а не контекстам
+  void set_dep_hierarchical_softmax()
+  {
+    if ( !dep_ctx_vocabulary )
+      return;
+    dep_hs = true;
+    build_huffman_tree();
+    // таблица шума в этом режиме не используется
+    if (table_dep)
+      free(table_dep);
+    table_dep = nullptr;
+  } // method-end
+  // вычисление сигмоиды без таблицы (с пакетной обработкой отрицательных примеров)
+  void set_poly_sigmoid(bool value)
+  {
+    poly_sigmoid = value;
+  } // method-end
+  // запуск выделенных потоков, применяющих данные внешних словарей (вызывается до запуска потоков обучения)
+  // в этом режиме поставщик обучающих примеров не прикрепляет словарные данные к примерам: потоки обучения лишь
+  // отчитываются о количестве обработанных примеров, а исполнители выдают пары с темпом, заданным в таблице словарей
+  void start_ext_workers(std::shared_ptr<ExternalVocabsManager> ext_vm, size_t workers_count)
+  {
+    ext_vocabs = ext_vm;
+    ext_examples_done = std::vector<PaddedCounter>( lep->get_threads_count() );
+    ext_workers_stop = false;
+    for (size_t i = 0; i < workers_count; ++i)
+      ext_workers.emplace_back(&Trainer::ext_worker_entry_point, this, i, workers_count);
+  } // method-end
+  // измерение конфликтов записи между потоками обучения (вызывается до запуска потоков обучения)
+  void set_conflict_sampler(std::shared_ptr<ConflictSampler> sampler)
+  {
+    conflicts = sampler;
+  } // method-end
+  // остановка выделенных потоков (вызывается после завершения потоков обучения; остаток пар применяется до выхода)
+  void stop_ext_workers()
+  {
+    ext_workers_stop = true;
+    for (auto& t : ext_workers)
+      t.join();
+    ext_workers.clear();
+  } // method-end
+  // калибровочный прогон skip_gram на синтетических обучающих примерах (оценка производительности без чтения корпуса):
+  // слова и ассоциативные контексты выбираются пропорционально частоте (с учетом сабсэмплинга), синтаксические -- по таблице шума;
+  // возвращает суммарное по всем потокам количество обработанных примеров в секунду
+  double calibrate(size_t threads_count, double seconds, size_t dep_per_word, size_t assoc_per_word)
+  {
+    int *table_words = nullptr;
+    InitUnigramTable(table_words, w_vocabulary);
+    std::atomic<uint64_t> examples{0};
+    const auto start_tp = std::chrono::steady_clock::now();
+    const auto deadline = start_tp + std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>(seconds) );
+    auto worker = [&, this](size_t thread_idx)
+    {
+      unsigned long long next_random = thread_idx + 1;
+      float *neu1e = (float *)calloc(layer1_size, sizeof(float));
+      LearningExample le;
+      uint64_t done = 0;
+      while ( (done & 0xFF) != 0 || std::chrono::steady_clock::now() < deadline )
+      {
+        update_random_ns(next_random);
+        le.word = table_words[(next_random >> 16) % table_size];
+        le.dep_context.clear();
+        for (size_t i = 0; table_dep && i < dep_per_word; ++i)
+        {
+          update_random_ns(next_random);
+          le.dep_context.push_back( table_dep[(next_random >> 16) % table_size] );
+        }
+        le.assoc_context.clear();
+        for (size_t i = 0; i < assoc_per_word; ++i)
+        {
+          update_random_ns(next_random);
+          le.assoc_context.push_back( table_words[(next_random >> 16) % table_size] );
+        }
+        skip_gram(le, neu1e, next_random);
+        ++done;
+      }
+      examples += done;
+      free(neu1e);
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads_count; ++t)
+      workers.emplace_back(worker, t);
+    worker(0);
+    for (auto& w : workers)
+      w.join();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_tp;
+    free(table_words);
+    return examples / elapsed.count();
+  } // method-end
   // функция усреднения векторов в векторном пространстве в соответствии с заданным списком
   // усредненный вектор записывается по идексу, соответствующему первому элементу списка
   void vectors_weighted_collapsing(const std::vector< std::vector< std::pair<size_t, float> > >& collapsing_info)
@@ -634,7 +956,8 @@ private:
   // табличное представление логистической функции в области определения [-MAX_EXP; +MAX_EXP]
   float *expTable = nullptr;
   // noise distribution for negative sampling
-  const size_t table_size = 1e8; // 100 млн.
+  static constexpr size_t NOISE_TABLE_SIZE = 1e8; // 100 млн.
+  const size_t table_size;
   int *table_dep = nullptr;
   // счетчики "ошибок" точности вычисления сигмоиды
   size_t dep_se_cnt = 0;
@@ -722,15 +1045,40 @@ private:
     // цикл по синтаксическим контекстам
     for (auto&& ctx_idx : le.dep_context)
     {
+      if ( !dep_ctx_vocabulary ) break; // синтаксическая часть не обучается (например, в одной из конфигураций группового обучения)
       // зануляем текущие значения ошибок (это частная производная ошибки E по выходу скрытого слоя h)
       std::fill(neu1e, neu1e+size_dep, 0.0);
-      for (size_t d = 0; d <= negative_d; ++d)
+      // (adagrad) средний квадрат компоненты вектора целевого слова -- для оценки градиентов векторов контекстов
+      const float target_sq = adagrad ? mean_sq(targetDepPtr, size_dep) : 0.0;
+      // (hs) вместо положительного и отрицательных примеров -- внутренние узлы на пути к контексту в дереве Хаффмана
+      if ( dep_hs )
+        hs_dep_context(ctx_idx, targetDepPtr, neu1e, target_sq);
+      for (size_t d = 0; d <= negative_d && !dep_hs; ++d)
       {
         if (d == 0) // на первой итерации рассматриваем положительный пример (контекст)
         {
           selected_ctx = ctx_idx;
           label = 1;
         }
+        else if ( poly_sigmoid )
+        {
+          // (poly) отрицательные примеры обрабатываются пакетом; оценки вычисляются после положительного примера,
+          // т.к. его обработка изменяет вектор контекста, который может оказаться и среди отрицательных примеров
+          // (вектор целевого слова в цикле по примерам не меняется, т.к. ошибка для него копится в neu1e)
+          if (d == 1)
+          {
+            negatives_batch.resize(negative_d + 1);
+            for (size_t n = 1; n <= negative_d; ++n)
+            {
+              update_random_ns(next_random_ns);
+              negatives_batch.idx[n] = table_dep[(next_random_ns >> 16) % table_size];
+              negatives_batch.f[n] = std::inner_product(targetDepPtr, targetDepEndPtr, syn1_dep + negatives_batch.idx[n] * size_dep, 0.0);
+            }
+            negatives_batch.sigmoid(1, negative_d);
+          }
+          selected_ctx = negatives_batch.idx[d];
+          label = 0;
+        }
         else // на остальных итерациях рассматриваем отрицательные примеры (случайные контексты из noise distribution)
         {
           update_random_ns(next_random_ns);
@@ -741,9 +1089,11 @@ private:
         float *ctxVectorPtr = syn1_dep + selected_ctx * size_dep;
         // в skip-gram выход скрытого слоя в точности соответствует вектору целевого слова
         // вычисляем выход нейрона выходного слоя (нейрона, соответствующего рассматриваемому положительному/отрицательному примеру) (hidden -> output)
-        float f = std::inner_product(targetDepPtr, targetDepEndPtr, ctxVectorPtr, 0.0);
+        // (для пакетно обработанных отрицательных примеров он уже вычислен)
+        float f = (poly_sigmoid && d > 0) ? negatives_batch.f[d] : std::inner_product(targetDepPtr, targetDepEndPtr, ctxVectorPtr, 0.0);
         if ( std::isnan(f) ) continue;
-        f = sigmoid(f);
+        if ( !poly_sigmoid || d == 0 )
+          f = sigmoid(f);
         if (f == 0.0 || f == 1.0)
           ++dep_se_cnt;
         // вычислим ошибку, умноженную на коэффициент скорости обучения
@@ -760,12 +1110,20 @@ private:
         // обучение весов hidden -> output
         if ( !toks_train )
         {
+          trace_update(ConflictSampler::ctSyn1Dep, selected_ctx);
+          mark_syn1_dep(selected_ctx);
           if ( (d == 0) /*|| (fraction < 0.1)*/ )
+          {
+            if ( adagrad )
+              g *= adagrad_rate(ada_syn1_dep[selected_ctx], (label - f) * (label - f) * target_sq);
             std::transform(ctxVectorPtr, ctxVectorPtr+size_dep, targetDepPtr, ctxVectorPtr, [g](float a, float b) -> float {return a + g*b;});
+          }
           else {
             float kk = 0.05 * alpha_d / negative_d;
             //float kk = alpha_d * alpha_d / negative_d;
             if (kk < 1e-9) kk = 1e-9;
+            if ( adagrad )
+              kk *= adagrad_rate(ada_syn1_dep[selected_ctx], (kk / alpha_d) * (kk / alpha_d) * target_sq);
             std::transform(ctxVectorPtr, ctxVectorPtr+size_dep, targetDepPtr, ctxVectorPtr, [kk](float a, float b) -> float {return a - kk*b;});
           }
           // ограничиваем значение в векторах контекста
@@ -775,6 +1133,15 @@ private:
         }
       } // for all samples
       // обучение весов input -> hidden
+      if ( adagrad )
+      {
+        const float rate = adagrad_rate(ada_syn0[le.word * 2], mean_sq(neu1e, size_dep) / (alpha_d * alpha_d));
+        std::transform(neu1e, neu1e+size_dep, neu1e, [rate](float v) -> float {return v*rate;});
+      }
+      trace_update(ConflictSampler::ctSyn0Dep, le.word);
+      mark_syn0(le.word);
+      if ( !touched_rows.empty() )
+        touched_rows[le.word] = 1;
       std::transform(targetDepPtr, targetDepEndPtr, neu1e, targetDepPtr, std::plus<float>());
       // ограничение степени выраженности признака
       std::transform(targetDepPtr, targetDepEndPtr, targetDepPtr, Trainer::space_threshold_functor);
@@ -817,6 +1184,24 @@ private:
           selected_ctx = ctx_idx;
           label = 1;
         }
+        else if ( poly_sigmoid )
+        {
+          // (poly) отрицательные примеры обрабатываются пакетом; выбираются после положительного примера,
+          // т.к. его обработка изменяет вектор целевого слова
+          if (d == 1)
+          {
+            negatives_batch.resize(operative_negative_a + 1);
+            for (size_t n = 1; n <= operative_negative_a; ++n)
+            {
+              update_random_ns(next_random_ns);
+              negatives_batch.idx[n] = (next_random_ns >> 16) % w_vocabulary_size;
+              negatives_batch.f[n] = std::inner_product(targetAssocPtr, targetAssocEndPtr, syn0 + negatives_batch.idx[n] * layer1_size + size_dep, 0.0);
+            }
+            negatives_batch.sigmoid(1, operative_negative_a);
+          }
+          selected_ctx = negatives_batch.idx[d];
+          label = 0;
+        }
         else // на остальных итерациях рассматриваем отрицательные примеры (случайные контексты из noise distribution)
         {
           update_random_ns(next_random_ns);
@@ -827,9 +1212,10 @@ private:
         // вычисляем смещение вектора, соответствующего очередному положительному/отрицательному примеру
         float *ctxVectorPtr = syn0 + selected_ctx * layer1_size + size_dep;
         // вычисляем оценку сходства
-        float f = std::inner_product(targetAssocPtr, targetAssocEndPtr, ctxVectorPtr, 0.0);
+        float f = (poly_sigmoid && d > 0) ? negatives_batch.f[d] : std::inner_product(targetAssocPtr, targetAssocEndPtr, ctxVectorPtr, 0.0);
         if ( std::isnan(f) ) continue;
-        f = sigmoid(f);
+        if ( !poly_sigmoid || d == 0 )
+          f = sigmoid(f);
         // if (f == 0.0 || f == 1.0)
         //   ++ass_se_cnt;
         // вычислим ошибку, умноженную на коэффициент скорости обучения
@@ -848,6 +1234,11 @@ private:
           // // ограничение степени выраженности признака
           // std::transform(targetAssocPtr, targetAssocEndPtr, targetAssocPtr, Trainer::space_threshold_functor);
 
+          if ( adagrad )
+            g *= adagrad_rate(ada_syn0[le.word * 2 + 1], (label - f) * (label - f) * mean_sq(ctxVectorPtr, size_assoc));
+          trace_update(ConflictSampler::ctSyn0Assoc, le.word);
+          mark_syn0(le.word);
+
           // std::transform( targetAssocPtr, targetAssocEndPtr, ctxVectorPtr, targetAssocPtr, 
           //                 [kk=alpha_a*0.01](float a, float b) -> float 
           //                 { 
@@ -884,6 +1275,11 @@ private:
           // // ограничение степени выраженности признака
           // std::transform(ctxVectorPtr, ctxVectorPtr+size_assoc, ctxVectorPtr, Trainer::space_threshold_functor);
 
+          if ( adagrad )
+            g *= adagrad_rate(ada_syn0[selected_ctx * 2 + 1], f * f * mean_sq(targetAssocPtr, size_assoc));
+          trace_update(ConflictSampler::ctSyn0Assoc, selected_ctx);
+          mark_syn0(selected_ctx);
+
           // std::transform( ctxVectorPtr, ctxVectorPtr+size_assoc, targetAssocPtr, ctxVectorPtr, 
           //                 [forcer=0.001*alpha_a, relaxer=-0.001*alpha_a](float a, float b) -> float 
           //                 { 
@@ -908,23 +1304,54 @@ private:
 
     // обработка данных от внешних словарей
     for ( size_t d = 0; d < le.ext_vocab_data.size(); ++d )
-    {
-      const auto& data = le.ext_vocab_data[d];
+      apply_ext_example(le.ext_vocab_data[d], neu1e);
 
-      float *vector1Ptr = syn0 + data.word1 * layer1_size + data.dims_from;
-      float *vector2Ptr = syn0 + data.word2 * layer1_size + data.dims_from;
-      const float alpha = (data.dims_from < size_dep) ? alpha_d : alpha_a;
-      const size_t to_end = data.dims_to - data.dims_from + 1;
-      switch ( data.algo )
-      {
-        case evaFirstWithOther:
-        case evaPairwise:          attract_vecs_s(vector1Ptr, vector2Ptr, to_end, data, alpha); break;
-        case evaPairwiseEuclidean: attract_vecs_e(vector1Ptr, vector2Ptr, to_end, data, neu1e, alpha); break;
-      }
-      
+  } // method-end
 
-    } // for all ext vocabs data
+  // обработка синтаксического контекста в режиме иерархического softmax (ошибка для вектора целевого слова копится в neu1e)
+  inline void hs_dep_context(size_t ctx_idx, float *targetDepPtr, float *neu1e, float target_sq)
+  {
+    float *targetDepEndPtr = targetDepPtr + size_dep;
+    for (uint64_t k = hs_offsets[ctx_idx]; k < hs_offsets[ctx_idx + 1]; ++k)
+    {
+      const size_t node = hs_points[k];
+      float *nodeVectorPtr = syn1_dep + node * size_dep;
+      float f = std::inner_product(targetDepPtr, targetDepEndPtr, nodeVectorPtr, 0.0);
+      if ( std::isnan(f) ) continue;
+      f = sigmoid(f);
+      if (f == 0.0 || f == 1.0)
+        ++dep_se_cnt;
+      // ветвь с кодом 0 -- "положительная" (как в word2vec)
+      const float err = 1 - hs_codes[k] - f;
+      float g = err * alpha_d;
+      if (g == 0) continue;
+      std::transform(neu1e, neu1e+size_dep, nodeVectorPtr, neu1e, [g](float a, float b) -> float {return a + g*b;});
+      if ( toks_train )
+        continue;
+      trace_update(ConflictSampler::ctSyn1Dep, node);
+      mark_syn1_dep(node);
+      if ( adagrad )
+        g *= adagrad_rate(ada_syn1_dep[node], err * err * target_sq);
+      std::transform(nodeVectorPtr, nodeVectorPtr+size_dep, targetDepPtr, nodeVectorPtr, [g](float a, float b) -> float {return a + g*b;});
+      std::transform(nodeVectorPtr, nodeVectorPtr+size_dep, nodeVectorPtr, Trainer::space_threshold_functor);
+    }
+  } // method-end
 
+  // применение данных внешнего словаря (пары слов) к векторам слов
+  inline void apply_ext_example(const ExtVocabExample& data, float *neu1e)
+  {
+    float *vector1Ptr = syn0 + data.word1 * layer1_size + data.dims_from;
+    float *vector2Ptr = syn0 + data.word2 * layer1_size + data.dims_from;
+    mark_syn0(data.word1);
+    mark_syn0(data.word2);
+    const float alpha = (data.dims_from < size_dep) ? alpha_d : alpha_a;
+    const size_t to_end = data.dims_to - data.dims_from + 1;
+    switch ( data.algo )
+    {
+      case evaFirstWithOther:
+      case evaPairwise:          attract_vecs_s(vector1Ptr, vector2Ptr, to_end, data, alpha); break;
+      case evaPairwiseEuclidean: attract_vecs_e(vector1Ptr, vector2Ptr, to_end, data, neu1e, alpha); break;
+    }
   } // method-end
 
   // стягивание векторов по "знаковой модели"
@@ -973,6 +1400,8 @@ private:
   // вычисление значения сигмоиды
   inline float sigmoid(float f) const
   {
+    if ( poly_sigmoid )
+      return FastSigmoid::value(f, MAX_EXP);
     // вариант с барьером
     // if      (f > MAX_EXP)  return 1;
     // else if (f < -MAX_EXP) return 0;
@@ -1032,13 +1461,85 @@ private:
       ++working_threads;
     }
   }
+  // точка синхронизации для вспомогательных потоков (исполнителей внешних словарей): они никогда не инициируют
+  // синхронное действие, но, если оно начато, уходят в ожидание наравне с потоками обучения
+  void sync_point()
+  {
+    std::unique_lock<std::mutex> cv_lock(mtx);
+    if ( !action_in_progress )
+      return;
+    --working_threads;
+    cv1.notify_one();
+    cv2.wait(cv_lock, [this]{return action_in_progress == false;});
+    ++working_threads;
+  }
+  // точка входа для выделенного исполнителя внешних словарей:
+  // исполнитель worker_idx суммирует счетчики примеров потоков обучения с номерами worker_idx, worker_idx+workers_count, ...
+  // и применяет пары в объеме, пропорциональном приросту суммы (так нагрузка делится между исполнителями без общих счетчиков)
+  void ext_worker_entry_point(size_t worker_idx, size_t workers_count)
+  {
+    std::unique_ptr<ThreadsInWorkCounterGuard> wth_guard = std::make_unique<ThreadsInWorkCounterGuard>(this);
+    const std::chrono::milliseconds IDLE_PAUSE(1);
+    float *neu1e = (float *)calloc(layer1_size, sizeof(float));
+    std::vector<uint64_t> residual;
+    std::vector<ExtVocabExample> batch;
+    unsigned long long next_random = lep->get_threads_count() + worker_idx;
+    uint64_t last_total = 0;
+    while (true)
+    {
+      sync_point();
+      // признак остановки читается до счетчиков, чтобы последний проход учел все обработанные примеры
+      const bool stopping = ext_workers_stop.load();
+      uint64_t total = 0;
+      for (size_t t = worker_idx; t < ext_examples_done.size(); t += workers_count)
+        total += ext_examples_done[t].value.load(std::memory_order_relaxed);
+      batch.clear();
+      ext_vocabs->get_paced(batch, fraction, total - last_total, residual, next_random);
+      last_total = total;
+      for (auto& data : batch)
+        apply_ext_example(data, neu1e);
+      if ( stopping )
+        break;
+      if ( batch.empty() )
+        std::this_thread::sleep_for(IDLE_PAUSE);
+    }
+    free(neu1e);
+  }
+  // раунд распределенной синхронизации (выполняется при приостановленных потоках обучения)
+  void distributed_sync()
+  {
+    DistributedSync::RoundResult result;
+    if ( !distributed_round(false, result) )
+      exit(1);
+  }
+  bool distributed_round(bool finished, DistributedSync::RoundResult& result)
+  {
+    DistributedSync::RoundInfo info;
+    info.words = words_since_sync;
+    info.dep_se = dep_se_cnt;
+    info.ass_se = ass_se_cnt;
+    info.finished = finished;
+    if ( !dist->round(info, result) )
+      return false;
+    words_since_sync = 0;
+    // прогресс и скорость обучения вычисляются по глобальному количеству обработанных слов
+    word_count_actual = result.global_words;
+    update_progress(0, false);
+    if ( result.rescale_dep && dep_ctx_vocabulary )
+      rescale_dep();
+    if ( result.rescale_assoc )
+      rescale_assoc();
+    return true;
+  }
   // масштабирование пространства
   void rescale_dep()
   {
     std::cout << "Dep. rescale" << std::endl;
+    // масштабирование меняет все строки syn0
+    std::fill(touched_rows.begin(), touched_rows.end(), 1);
     for (size_t a = 0; a < w_vocabulary->size(); ++a)
       std::transform(syn0+a*layer1_size, syn0+a*layer1_size+size_dep, syn0+a*layer1_size, [](float v) -> float {return v*0.9;});
-    for (size_t a = 0; a < dep_ctx_vocabulary->size(); ++a)
+    for (size_t a = 0; a < dep_rows(); ++a)
       std::transform(syn1_dep+a*size_dep, syn1_dep+a*size_dep+size_dep, syn1_dep+a*size_dep, [](float v) -> float {return v*0.8;});
     dep_se_total += dep_se_cnt;
     dep_se_cnt = 0;
@@ -1051,15 +1552,28 @@ private:
     ass_se_total += ass_se_cnt;
     ass_se_cnt = 0;
   }
+  // проверка, настал ли момент обновления subsampling-коэффициентов
+  bool is_subsampling_checkpoint() const
+  {
+    //return (upd_ss_cnt == 0 && fraction >= 0.25) || (upd_ss_cnt == 1 && fraction >= 0.5) || (upd_ss_cnt == 2 && fraction >= 0.75);
+    return (upd_ss_cnt == 0 && fraction >= 0.40) || (upd_ss_cnt == 1 && fraction >= 0.60) || (upd_ss_cnt == 2 && fraction >= 0.80);
+  }
   // обновление subsampling-коэффициентов
   void decrease_subsampling()
   {
-    ++upd_ss_cnt;
     std::cout << "Decrease subsampling" << std::endl;
     lep->update_subsampling_rates(0.5 /*, 0.95, 0.95*/); // выполняем первым, т.к. InitUnigramTable зависит от уже вычисленных sample_probability в словарях
+    subsampling_decreased();
+  }
+  // перестроение зависящих от subsampling данных тренера
+  // (при групповом обучении поставщик примеров общий, и коэффициенты в нём обновляются однократно, а эта часть -- для каждого тренера)
+  void subsampling_decreased()
+  {
+    ++upd_ss_cnt;
     if (table_dep)
       free(table_dep);
-    if ( dep_ctx_vocabulary )
+    table_dep = nullptr;
+    if ( dep_ctx_vocabulary && !dep_hs )
       InitUnigramTable(table_dep, dep_ctx_vocabulary);
   }
   // вывод отладочных гистограмм о пространстве
@@ -1124,7 +1638,346 @@ private:
   // периодичность, с которой корректируется "коэф.скорости обучения"
   long long alpha_chunk = 0;
   std::chrono::steady_clock::time_point start_learning_tp;
+  // префикс имен файлов для размещения весовых матриц в отображаемой памяти (пустой -- обычная память)
+  std::string mmap_prefix;
+  // размеры отображений (ненулевые, если матрица размещена в отображаемом файле)
+  size_t syn0_mmap_bytes = 0;
+  size_t syn1_dep_mmap_bytes = 0;
+  // ключ генератора начальных значений весов
+  static constexpr uint64_t INIT_RNG_KEY = 1;
+  // адаптивная скорость обучения строк: глобальный коэффициент (alpha) домножается на 1/sqrt(acc),
+  // где acc -- накопленная сумма квадратов градиента строки (в расчете на одно измерение)
+  // начальное значение накопителя 1.0, т.е. первое обновление строки выполняется с глобальным коэффициентом
+  static constexpr float ADAGRAD_INITIAL_ACC = 1.0;
+  bool adagrad = false;
+  std::vector<float> ada_syn0;
+  std::vector<float> ada_syn1_dep;
+  static inline float adagrad_rate(float& acc, float grad_sq)
+  {
+    acc += grad_sq;
+    return 1.0 / std::sqrt(acc);
+  } // method-end
+  static inline float mean_sq(const float* v, size_t n)
+  {
+    return std::inner_product(v, v+n, v, 0.0) / n;
+  } // method-end
+  // сигмоида вычисляется без таблицы (FastSigmoid), оценки отрицательных примеров -- пакетом
+  bool poly_sigmoid = false;
+  // признаки изменения строк syn0 (заполняются, только если вызван track_touched_rows)
+  std::vector<uint8_t> touched_rows;
+  // иерархический softmax для синтаксической части: пути от корня дерева Хаффмана к контекстам в формате CSR
+  // (узлы и коды пути контекста c -- элементы hs_offsets[c] .. hs_offsets[c+1]-1); внутренние узлы пронумерованы
+  // по убыванию суммарной частоты (корень -- 0), так что часто посещаемые строки syn1_dep лежат компактно в начале матрицы
+  bool dep_hs = false;
+  std::vector<uint64_t> hs_offsets;
+  std::vector<uint32_t> hs_points;
+  std::vector<uint8_t> hs_codes;
+  // количество строк матрицы syn1_dep
+  size_t dep_rows() const
+  {
+    if ( !dep_ctx_vocabulary )
+      return 0;
+    return dep_hs ? std::max<size_t>(1, dep_ctx_vocabulary->size() - 1) : dep_ctx_vocabulary->size();
+  } // method-end
+  // построение дерева Хаффмана по частотам словаря синтаксических контекстов (алгоритм word2vec: два указателя по отсортированным частотам)
+  void build_huffman_tree()
+  {
+    const size_t vocab_size = dep_ctx_vocabulary->size();
+    hs_offsets.assign(vocab_size + 1, 0);
+    hs_points.clear();
+    hs_codes.clear();
+    if ( vocab_size < 2 )
+      return;
+    // листья упорядочиваются по убыванию частоты
+    std::vector<size_t> order(vocab_size);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return dep_ctx_vocabulary->idx_to_data(a).cn > dep_ctx_vocabulary->idx_to_data(b).cn; });
+    std::vector<uint64_t> count(vocab_size * 2 - 1, std::numeric_limits<uint64_t>::max());
+    std::vector<uint8_t> binary(vocab_size * 2 - 1, 0);
+    std::vector<size_t> parent(vocab_size * 2 - 1, 0);
+    for (size_t a = 0; a < vocab_size; ++a)
+      count[a] = dep_ctx_vocabulary->idx_to_data(order[a]).cn;
+    long long pos1 = vocab_size - 1;
+    size_t pos2 = vocab_size;
+    auto pick_min = [&]() -> size_t
+    {
+      if ( pos1 >= 0 && count[pos1] < count[pos2] )
+        return pos1--;
+      return pos2++;
+    };
+    for (size_t a = 0; a < vocab_size - 1; ++a)
+    {
+      const size_t min1 = pick_min();
+      const size_t min2 = pick_min();
+      count[vocab_size + a] = count[min1] + count[min2];
+      parent[min1] = vocab_size + a;
+      parent[min2] = vocab_size + a;
+      binary[min2] = 1;
+    }
+    // внутренний узел vocab_size+a получает номер строки (vocab_size-2-a): чем позже создан узел, тем он частотнее
+    const size_t root = vocab_size * 2 - 2;
+    std::vector< std::vector<uint32_t> > points(vocab_size);
+    std::vector< std::vector<uint8_t> > codes(vocab_size);
+    for (size_t a = 0; a < vocab_size; ++a)
+    {
+      auto& p = points[order[a]];
+      auto& c = codes[order[a]];
+      for (size_t b = a; b != root; b = parent[b])
+      {
+        c.push_back( binary[b] );
+        p.push_back( static_cast<uint32_t>(root - parent[b]) );
+      }
+      std::reverse(p.begin(), p.end());
+      std::reverse(c.begin(), c.end());
+    }
+    for (size_t i = 0; i < vocab_size; ++i)
+    {
+      hs_points.insert(hs_points.end(), points[i].begin(), points[i].end());
+      hs_codes.insert(hs_codes.end(), codes[i].begin(), codes[i].end());
+      hs_offsets[i + 1] = hs_points.size();
+    }
+    std::cout << "Huffman tree for dependency contexts: " << (vocab_size - 1) << " inner nodes, average path length "
+              << static_cast<double>(hs_points.size()) / vocab_size << std::endl;
+  } // method-end
+  // измерение конфликтов записи: буфер потока заполняется в skip_gram
+  std::shared_ptr<ConflictSampler> conflicts;
+  static inline thread_local ConflictSampler::Ring* conflict_ring = nullptr;
+  inline void trace_update(ConflictSampler::Target target, size_t row)
+  {
+    if ( conflict_ring )
+      conflict_ring->push(target, row);
+  } // method-end
+  // отметка строк, изменяемых между раундами распределенной синхронизации (передаются только они)
+  inline void mark_syn0(size_t row)
+  {
+    if ( dist_touched_syn0 )
+      dist_touched_syn0[row] = 1;
+  } // method-end
+  inline void mark_syn1_dep(size_t row)
+  {
+    if ( dist_touched_syn1_dep )
+      dist_touched_syn1_dep[row] = 1;
+  } // method-end
+  // выделенные исполнители внешних словарей
+  struct alignas(64) PaddedCounter
+  {
+    std::atomic<uint64_t> value{0};
+  };
+  std::shared_ptr<ExternalVocabsManager> ext_vocabs;
+  std::vector<PaddedCounter> ext_examples_done;   // счетчики обработанных примеров (по одному на поток обучения)
+  std::vector<std::thread> ext_workers;
+  std::atomic<bool> ext_workers_stop{false};
+  // буфер пакетной обработки отрицательных примеров: индексы контекстов и оценки (сначала скалярные произведения, затем сигмоиды)
+  struct NegativesBatch
+  {
+    std::vector<size_t> idx;
+    std::vector<float> f;
+    void resize(size_t n)
+    {
+      if (idx.size() < n) { idx.resize(n); f.resize(n); }
+    }
+    void sigmoid(size_t from, size_t count)
+    {
+      FastSigmoid::batch(f.data() + from, f.data() + from, count, MAX_EXP);
+    }
+  };
+  static inline thread_local NegativesBatch negatives_batch;
+  // учет прогресса обучения грамматических векторов и пересчет коэффициента скорости обучения
+  void update_progress__gramm(long long words_delta, uint64_t words_total)
+  {
+    word_count_actual += words_delta;
+    fraction = word_count_actual / (float)(words_total + 1);
+    //if ( debug_mode != 0 )
+    {
+      std::chrono::steady_clock::time_point current_learning_tp = std::chrono::steady_clock::now();
+      std::chrono::duration< double, std::ratio<1> > learning_seconds = current_learning_tp - start_learning_tp;
+      printf( "\rAlpha: %f  Progress: %.2f%%  Words/sec: %.2fk   ", alpha_g,
+              fraction * 100,
+              word_count_actual / (learning_seconds.count() * 1000) );
+      fflush(stdout);
+    }
+    alpha_g = starting_alpha_g * (1.0 - fraction);
+    if ( alpha_g < starting_alpha_g * 0.0001 )
+      alpha_g = starting_alpha_g * 0.0001;
+  } // method-end
+  // дедуплицированная таблица примеров для грамматических векторов
+  struct GrammExample
+  {
+    size_t word;
+    uint64_t grammemes;
+    uint64_t cn;
+  };
+  struct GrammKeyHash
+  {
+    size_t operator()(const std::pair<size_t, uint64_t>& key) const
+    {
+      return std::hash<size_t>()(key.first) ^ (std::hash<uint64_t>()(key.second) * 0x9E3779B97F4A7C15ULL);
+    }
+  };
+  typedef std::unordered_map<std::pair<size_t, uint64_t>, uint64_t, GrammKeyHash> GrammCounts;
+  std::vector<GrammExample> gramm_table;
+  std::vector<double> gramm_table_cdf;   // накопленные веса (для выборки пропорционально частоте)
+  uint64_t gramm_steps_total = 0;        // общее количество примеров, предъявляемых сети (с учетом эпох)
+  // подсчет пар (слово, граммемы) в части корпуса (точка входа для потоков)
+  void collect_entry_point__gramm( size_t thread_idx, GrammCounts& counts )
+  {
+    if ( !lep->epoch_prepare(thread_idx) )
+      return;
+    while (true)
+    {
+      auto learning_example = lep->get(thread_idx, 0.0, true);
+      if (!learning_example) break;
+      ++counts[ std::make_pair(learning_example->word, learning_example->grammemes) ];
+    }
+    lep->epoch_unprepare(thread_idx);
+  } // method-end
+  // размер мини-пакета обучающих примеров при обучении грамматических векторов
+  static constexpr size_t GRAMM_BATCH_SIZE = 32;
+  // рабочие матрицы мини-пакета; часть матриц хранится транспонированной, чтобы внутренние циклы
+  // всех матричных произведений шли по непрерывной памяти без редукции (векторизуются компилятором)
+  struct GrammBatch
+  {
+    std::vector<size_t> words;    // индексы слов пакета
+    std::vector<uint64_t> targets; // маски граммем
+    std::vector<float> x;         // вектора слов (B x size_gramm)
+    std::vector<float> xt;        // они же, транспонированные (size_gramm x B)
+    std::vector<float> et;        // выходы сети, затем ошибки, умноженные на alpha (output_size x B)
+    std::vector<float> eht;       // дельты скрытого слоя (size_gramm x B)
+    GrammBatch(size_t output_size, size_t size_gramm)
+    : words(GRAMM_BATCH_SIZE), targets(GRAMM_BATCH_SIZE)
+    , x(GRAMM_BATCH_SIZE * size_gramm), xt(size_gramm * GRAMM_BATCH_SIZE)
+    , et(output_size * GRAMM_BATCH_SIZE), eht(size_gramm * GRAMM_BATCH_SIZE)
+    { }
+  };
+  // шаг обучения грамматических векторов на мини-пакете из n примеров
+  void gramm_train_batch(GrammBatch& gb, size_t n)
+  {
+    const size_t B = GRAMM_BATCH_SIZE;
+    const size_t output_size = lep->getGrammemesVectorSize();
+    // сборка векторов слов
+    for (size_t b = 0; b < n; ++b)
+    {
+      const float* wordVectorPtr = syn0 + gb.words[b] * size_gramm;
+      std::copy(wordVectorPtr, wordVectorPtr + size_gramm, gb.x.data() + b * size_gramm);
+      for (size_t i = 0; i < size_gramm; ++i)
+        gb.xt[i * B + b] = wordVectorPtr[i];
+    }
+    // прямой проход: Y^T = W * X^T
+    std::fill(gb.et.begin(), gb.et.end(), 0.0);
+    for (size_t g = 0; g < output_size; ++g)
+      for (size_t i = 0; i < size_gramm; ++i)
+      {
+        const float w = syn1_assoc[g * size_gramm + i];
+        float* yRow = gb.et.data() + g * B;
+        const float* xRow = gb.xt.data() + i * B;
+        for (size_t b = 0; b < n; ++b)
+          yRow[b] += w * xRow[b];
+      }
+    // ошибки, умноженные на коэффициент скорости обучения
+    for (size_t g = 0; g < output_size; ++g)
+    {
+      float* eRow = gb.et.data() + g * B;
+      if ( poly_sigmoid )
+        FastSigmoid::batch(eRow, eRow, n, MAX_EXP);
+      else
+        for (size_t b = 0; b < n; ++b)
+          eRow[b] = sigmoid(eRow[b]);
+      for (size_t b = 0; b < n; ++b)
+        eRow[b] = ( static_cast<float>((gb.targets[b] >> g) & 1) - eRow[b] ) * alpha_g;
+    }
+    // дельты скрытого слоя (по значениям второй матрицы до её обновления): EH^T = W^T * E^T
+    std::fill(gb.eht.begin(), gb.eht.end(), 0.0);
+    for (size_t g = 0; g < output_size; ++g)
+      for (size_t i = 0; i < size_gramm; ++i)
+      {
+        const float w = syn1_assoc[g * size_gramm + i];
+        float* ehRow = gb.eht.data() + i * B;
+        const float* eRow = gb.et.data() + g * B;
+        for (size_t b = 0; b < n; ++b)
+          ehRow[b] += w * eRow[b];
+      }
+    // преобразуем вторую матрицу: W += E^T * X
+    for (size_t b = 0; b < n; ++b)
+      for (size_t g = 0; g < output_size; ++g)
+      {
+        const float e = gb.et[g * B + b];
+        float* wRow = syn1_assoc + g * size_gramm;
+        const float* xRow = gb.x.data() + b * size_gramm;
+        for (size_t i = 0; i < size_gramm; ++i)
+          wRow[i] += e * xRow[i];
+      }
+    // преобразуем первую матрицу
+    for (size_t b = 0; b < n; ++b)
+    {
+      float* wordVectorPtr = syn0 + gb.words[b] * size_gramm;
+      for (size_t i = 0; i < size_gramm; ++i)
+        wordVectorPtr[i] += gb.eht[i * B + b];
+      // ограничение степени выраженности признака
+      std::transform(wordVectorPtr, wordVectorPtr+size_gramm, wordVectorPtr, Trainer::space_threshold_functor);
+    }
+  } // method-end
+  // синхронизация с другими узлами (при распределенном обучении)
+  std::shared_ptr<DistributedSync> dist;
+  // признаки строк, измененных с момента последней синхронизации (выставляются только при распределенном обучении)
+  uint8_t* dist_touched_syn0 = nullptr;
+  uint8_t* dist_touched_syn1_dep = nullptr;
+  // количество слов, обработанных узлом с момента последней синхронизации
+  uint64_t words_since_sync = 0;
+
+  // учет обработанных слов; при распределенном обучении между синхронизациями глобальный прогресс
+  // экстраполируется (остальные узлы обрабатывают свои части корпуса с сопоставимой скоростью)
+  void count_words(long long words_delta)
+  {
+    word_count_actual += words_delta * (dist ? dist->get_nodes_count() : 1);
+    words_since_sync += words_delta;
+  } // method-end
 
+  // выделение памяти под весовую матрицу (обычной или отображаемой в файл)
+  float* alloc_matrix(size_t rows, size_t cols, const std::string& mmap_suffix, size_t& mmap_bytes)
+  {
+    float* result = nullptr;
+    mmap_bytes = 0;
+    if ( !mmap_prefix.empty() )
+    {
+      result = MmapMatrix::create(mmap_prefix + mmap_suffix, rows * cols * sizeof(float));
+      if (result == nullptr) {std::cerr << "Memory mapping failed" << std::endl; exit(1);}
+      mmap_bytes = rows * cols * sizeof(float);
+      return result;
+    }
+    long long ap = posix_memalign((void **)&result, 128, (long long)rows * cols * sizeof(float));
+    if (result == nullptr || ap != 0) {std::cerr << "Memory allocation failed" << std::endl; exit(1);}
+    return result;
+  } // method-end
+  // выполнение func(from, to) над непересекающимися диапазонами строк матрицы в нескольких потоках
+  void parallel_rows(size_t rows, std::function<void(size_t, size_t)> func) const
+  {
+    const size_t threads_count = std::max<size_t>(1, std::min(lep ? lep->get_threads_count() : 1, rows));
+    const size_t chunk = (rows + threads_count - 1) / threads_count;
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads_count; ++t)
+      workers.emplace_back(func, std::min(rows, t * chunk), std::min(rows, (t + 1) * chunk));
+    func(0, std::min(rows, chunk));
+    for (auto& w : workers)
+      w.join();
+  } // method-end
+  void free_matrix(float* matrix, size_t mmap_bytes, const std::string& mmap_suffix)
+  {
+    if (mmap_bytes)
+      MmapMatrix::release(matrix, mmap_bytes, mmap_prefix + mmap_suffix);
+    else
+      free_aligned(matrix);
+  } // method-end
+  // количество строк словаря (упорядоченного по убыванию частоты), покрывающих основную массу употреблений
+  size_t hot_rows_count(std::shared_ptr< CustomVocabulary > vocabulary) const
+  {
+    const double HOT_MASS = 0.95;
+    const double limit = vocabulary->cn_sum() * HOT_MASS;
+    double acc = 0;
+    size_t rows = 0;
+    while (rows < vocabulary->size() && acc < limit)
+      acc += vocabulary->idx_to_data(rows++).cn;
+    return rows;
+  } // method-end
   void saveEmbeddingsBin_helper(FILE *fo, std::shared_ptr< CustomVocabulary > vocabulary, float *weight_matrix, size_t emb_size) const
   {
     for (size_t a = 0; a < vocabulary->size(); ++a)
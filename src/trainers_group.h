@@ -0,0 +1,161 @@
+#ifndef TRAINERS_GROUP_H_
+#define TRAINERS_GROUP_H_
+
+#include "trainer.h"
+#include "learning_example_provider.h"
+#include "command_line_parameters_defs.h"
+#include "str_conv.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <iostream>
+
+
+// Группа тренеров, обучающихся на общем потоке обучающих примеров.
+// Позволяет за один проход по корпусу (с однократным разбором conll и подстановкой словосочетаний) обучить
+// несколько моделей с разными параметрами. У каждого тренера свои матрицы весов и свой график скорости обучения.
+class TrainersGroup
+{
+public:
+  // конструктор
+  TrainersGroup(const std::vector< std::shared_ptr<Trainer> >& group_trainers)
+  : trainers(group_trainers)
+  , lep(group_trainers.front()->lep)
+  {
+  }
+  // загрузка списка конфигураций
+  // каждая строка файла задаёт параметры командной строки, переопределяемые для очередной модели, например:
+  //   -model v60_40.c2v -size_d 60 -size_a 40
+  //   -model v70_50.c2v -size_d 70 -size_a 50 -negative_d 7 -alpha_d 0.03
+  static bool load_configs(const std::string& filename, const CommandLineParametersDefs& base, std::vector<CommandLineParametersDefs>& configs)
+  {
+    // переопределять можно только то, что не влияет на поток обучающих примеров
+    const std::set<std::string> OVERRIDABLE = { "-model", "-backup", "-size_d", "-size_a", "-negative_d", "-negative_a",
+                                                "-alpha_d", "-alpha_a", "-inflection", "-mwe_collapse", "-adagrad", "-sigmoid",
+                                                "-objective_d" };
+    configs.clear();
+    std::ifstream ifs(filename);
+    if ( !ifs.good() )
+    {
+      std::cerr << "Can't open train configurations file: " << filename << std::endl;
+      return false;
+    }
+    std::set<std::string> models;
+    std::string line;
+    while ( std::getline(ifs, line) )
+    {
+      StrConv::trim(line);
+      if (line.empty()) continue;
+      if (line[0] == '#') continue;
+      std::vector<std::string> args;
+      StrUtil::split_by_whitespaces(line, args);
+      if ( args.size() % 2 != 0 )
+      {
+        std::cerr << "Invalid train configuration: " << line << std::endl;
+        return false;
+      }
+      for (size_t i = 0; i < args.size(); i += 2)
+      {
+        if ( OVERRIDABLE.find(args[i]) == OVERRIDABLE.end() )
+        {
+          std::cerr << "Parameter can't be overridden in train configuration: " << args[i] << std::endl;
+          return false;
+        }
+      }
+      configs.push_back(base);
+      configs.back().parse(args);
+      if ( !models.insert(configs.back().getAsString("-model")).second )
+      {
+        std::cerr << "Train configurations must have different -model values: " << line << std::endl;
+        return false;
+      }
+    }
+    if ( configs.empty() )
+    {
+      std::cerr << "No train configurations in " << filename << std::endl;
+      return false;
+    }
+    return true;
+  } // method-end
+  // процедура группового обучения (точка входа для потоков)
+  // каждый обучающий пример читается из корпуса однократно и передаётся всем тренерам группы
+  void train_entry_point( size_t thread_idx )
+  {
+    // синхронные действия выполняются на всей группе разом, координирует их первый тренер
+    Trainer& master = *trainers.front();
+    std::unique_ptr<ThreadsInWorkCounterGuard> wth_guard = std::make_unique<ThreadsInWorkCounterGuard>(&master);
+
+    // у каждого тренера свой буфер ошибки и своя последовательность для negative sampling
+    std::vector< std::unique_ptr<float[]> > neu1e( trainers.size() );
+    std::vector<unsigned long long> next_random_ns( trainers.size(), thread_idx );
+    for (size_t i = 0; i < trainers.size(); ++i)
+      neu1e[i] = std::make_unique<float[]>(trainers[i]->layer1_size);
+    // цикл по эпохам
+    for (size_t epochIdx = 0; epochIdx < master.epoch_count; ++epochIdx)
+    {
+      if ( !lep->epoch_prepare(thread_idx) )
+        return;
+      long long word_count = 0, last_word_count = 0;
+      // цикл по словам
+      while (true)
+      {
+        // вывод прогресс-сообщений (только для первого тренера)
+        // и корректировка коэффициентов скорости обучения (alpha) каждого тренера
+        if (word_count - last_word_count > master.alpha_chunk)
+        {
+          for (size_t i = 0; i < trainers.size(); ++i)
+            trainers[i]->update_progress(word_count - last_word_count, (i == 0));
+          last_word_count = word_count;
+          if ( is_sync_checkpoint() )
+            master.do_sync_action(thread_idx, [this](Trainer&) { sync_action(); });
+        } // if ('checkpoint')
+        // читаем очередной обучающий пример
+        auto learning_example = lep->get(thread_idx, master.fraction);
+        word_count = lep->getWordsCount(thread_idx);
+        if (!learning_example) break; // признак окончания эпохи (все обучающие примеры перебраны)
+        // используем обучающий пример для обучения всех нейросетей группы
+        for (size_t i = 0; i < trainers.size(); ++i)
+          trainers[i]->skip_gram( learning_example.value(), neu1e[i].get(), next_random_ns[i] );
+      } // for all learning examples
+      for (auto& t : trainers)
+        t->count_words(word_count - last_word_count);
+      if ( !lep->epoch_unprepare(thread_idx) )
+        return;
+    } // for all epochs
+  } // method-end: train_entry_point
+private:
+  std::vector< std::shared_ptr<Trainer> > trainers;
+  std::shared_ptr< LearningExampleProvider > lep;
+
+  // проверка, требуется ли синхронное действие хотя бы для одного тренера группы
+  bool is_sync_checkpoint() const
+  {
+    for (auto& t : trainers)
+      if (t->dep_se_cnt >= 1000000 || t->ass_se_cnt >= 1000000)
+        return true;
+    return trainers.front()->is_subsampling_checkpoint();
+  }
+  // синхронное действие над группой (выполняется, когда остальные потоки в ожидании)
+  void sync_action()
+  {
+    for (auto& t : trainers)
+    {
+      if (t->dep_se_cnt >= 1000000)
+        t->rescale_dep();
+      if (t->ass_se_cnt >= 1000000)
+        t->rescale_assoc();
+    }
+    if ( trainers.front()->is_subsampling_checkpoint() )
+    {
+      trainers.front()->decrease_subsampling(); // коэффициенты в общем поставщике примеров обновляем однократно
+      for (size_t i = 1; i < trainers.size(); ++i)
+        trainers[i]->subsampling_decreased();
+    }
+  }
+}; // class-decl-end
+
+
+#endif /* TRAINERS_GROUP_H_ */
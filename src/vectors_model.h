@@ -5,6 +5,7 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <fstream>
 #include <iostream>
 
@@ -196,6 +197,100 @@ public:
     std::copy(ext.embeddings, ext.embeddings + ext.words_count*ext.emb_size, embeddings+new_data_future_offset);
     return true;
   }
+  // наложение дельта-файла (см. Trainer::saveDelta): модель перестраивается по записанному в дельте составу и порядку строк,
+  // после чего вектора (их часть в диапазоне измерений [begin, end)) из дельты замещают текущие
+  // формат заголовка: <количество строк> <размерность модели> <dep_size> <assoc_size> <gramm_size> <begin> <end> <строк в итоговой модели>
+  // за заголовком следуют слова итоговой модели (по одному в строке), затем строки дельты
+  bool apply_delta(const std::string& delta_fn)
+  {
+    std::ifstream ifs(delta_fn.c_str(), std::ios::binary);
+    if ( !ifs.good() )
+    {
+      std::cerr << "Delta file not found: " << delta_fn << std::endl;
+      return false;
+    }
+    size_t rows = 0, d_emb_size = 0, d_dep = 0, d_assoc = 0, d_gramm = 0, begin = 0, end = 0, order_cnt = 0;
+    std::string buf;
+    ifs >> rows >> d_emb_size >> d_dep >> d_assoc >> d_gramm >> begin >> end >> order_cnt;
+    std::getline(ifs,buf); // считываем конец строки
+    if ( !ifs.good() || begin > end || end > d_emb_size )
+    {
+      std::cerr << "Invalid delta file header: " << delta_fn << std::endl;
+      return false;
+    }
+    if ( d_emb_size != emb_size || d_dep != dep_size || d_assoc != assoc_size || d_gramm != gramm_size )
+    {
+      std::cerr << "Delta dimensions differ from the model dimensions." << std::endl;
+      return false;
+    }
+    std::vector<std::string> order(order_cnt);
+    for (auto& w : order)
+      std::getline(ifs, w);
+    if ( !ifs.good() )
+    {
+      std::cerr << "Delta file is truncated: " << delta_fn << std::endl;
+      return false;
+    }
+    std::unordered_map<std::string, size_t> index;
+    index.reserve(words_count);
+    for (size_t idx = 0; idx < words_count; ++idx)
+      index.emplace(vocab[idx], idx);
+    // перестраиваем модель: строки, не вошедшие в итоговый состав, отбрасываются
+    float* rebuilt = (float *) malloc( order_cnt * emb_size * sizeof(float) );
+    if (rebuilt == nullptr && order_cnt > 0)
+    {
+      report_alloc_error();
+      return false;
+    }
+    for (size_t r = 0; r < order_cnt; ++r)
+    {
+      auto it = index.find(order[r]);
+      if ( it == index.end() )
+      {
+        std::cerr << "Delta refers to a word missing in the model: " << order[r] << std::endl;
+        free(rebuilt);
+        return false;
+      }
+      std::copy(embeddings + it->second * emb_size, embeddings + (it->second + 1) * emb_size, rebuilt + r * emb_size);
+    }
+    const size_t base_rows = words_count - do_not_save.size();
+    free(embeddings);
+    embeddings = rebuilt;
+    vocab.swap(order);
+    words_count = vocab.size();
+    do_not_save.clear();
+    index.clear();
+    for (size_t idx = 0; idx < words_count; ++idx)
+      index[ vocab[idx] ] = idx;  // при повторе слова дельта относится к строке словаря словоформ (она идет последней)
+    std::vector<float> row(end - begin);
+    std::string word;
+    size_t applied = 0, missed = 0;
+    for (size_t r = 0; r < rows; ++r)
+    {
+      std::getline(ifs, word, ' '); // читаем слово (до пробела)
+      ifs.read( reinterpret_cast<char*>( row.data() ), sizeof(float)*row.size() );
+      std::getline(ifs,buf); // считываем конец строки
+      if ( !ifs.good() )
+      {
+        std::cerr << "Delta file is truncated: " << delta_fn << std::endl;
+        return false;
+      }
+      auto it = index.find(word);
+      if ( it == index.end() )
+      {
+        ++missed;
+        continue;
+      }
+      std::copy(row.begin(), row.end(), embeddings + it->second * emb_size + begin);
+      ++applied;
+    }
+    std::cout << "Delta applied: " << applied << " rows";
+    if ( missed > 0 )
+      std::cout << " (" << missed << " words not found in model)";
+    std::cout << std::endl;
+    std::cout << "Model rows: " << base_rows << " -> " << words_count << std::endl;
+    return true;
+  } // method-end
   // статический метод для порождения случайного вектора, близкого к заданному (память должна быть выделена заранее)
   static void make_embedding_as_neighbour( size_t emb_size, float* base_embedding, float* new_embedding, float distance_factor = 1.0 )
   {
@@ -0,0 +1,226 @@
+#ifndef VOCAB_SPILL_H_
+#define VOCAB_SPILL_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+// Сброс частотного словаря на диск при превышении ограничения памяти (точный подсчет во внешней памяти).
+// Словарь записывается сериями -- отсортированными по ключу последовательностями записей (ключ, значение), после чего очищается.
+// По окончании подсчета серии сливаются (k-путевое слияние): значения одинаковых ключей суммируются, и каждый ключ
+// с итоговым значением передается обработчику ровно один раз в порядке возрастания.
+// Значение -- частота (uint64_t) или частоты лемм токена (std::map<std::string, size_t>).
+class VocabSpill
+{
+public:
+  // file_prefix -- префикс имен файлов серий
+  void init(const std::string& file_prefix)
+  {
+    prefix = file_prefix;
+  } // method-end
+  // ограничение памяти словаря (0 -- без сброса)
+  void set_limit(uint64_t memory_limit)
+  {
+    limit = memory_limit;
+  } // method-end
+  // учет памяти, занятой новой записью словаря (используется приближенная оценка)
+  void add_bytes(const std::string& key)
+  {
+    bytes += key.size() + ENTRY_OVERHEAD;
+  } // method-end
+  bool over_limit() const
+  {
+    return limit > 0 && bytes >= limit;
+  } // method-end
+  bool has_runs() const
+  {
+    return !files.empty();
+  } // method-end
+  size_t runs_count() const
+  {
+    return files.size();
+  } // method-end
+  // запись словаря в очередную серию и его очистка
+  template <typename Map>
+  bool spill(Map& vocab)
+  {
+    std::vector<typename Map::const_pointer> records;
+    records.reserve(vocab.size());
+    for (auto& record : vocab)
+      records.push_back(&record);
+    std::sort(records.begin(), records.end(), [](auto a, auto b) { return a->first < b->first; });
+    const std::string fn = prefix + "." + std::to_string(files.size());
+    std::ofstream ofs( fn.c_str(), std::ios::binary );
+    for (auto record : records)
+    {
+      write_string(ofs, record->first);
+      write_value(ofs, record->second);
+    }
+    ofs.close();
+    files.push_back(fn);
+    if ( ofs.fail() )
+    {
+      std::cerr << "Temporary file write error: " << fn << std::endl;
+      return false;
+    }
+    vocab.clear();
+    bytes = 0;
+    return true;
+  } // method-end
+  // слияние серий: on_record(key, value) вызывается для каждого ключа с суммарным значением
+  template <typename Value>
+  bool merge(std::function<void(const std::string&, Value&)> on_record)
+  {
+    // читатели серий и куча их текущих ключей (наименьший ключ -- наверху)
+    struct Run
+    {
+      std::ifstream ifs;
+      std::string key;
+      Value value;
+      bool failed = false;
+    };
+    std::vector< std::unique_ptr<Run> > runs;
+    auto greater = [&runs](size_t a, size_t b) { return runs[a]->key > runs[b]->key; };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (auto& fn : files)
+    {
+      runs.emplace_back( std::make_unique<Run>() );
+      auto& run = *runs.back();
+      run.ifs.open( fn.c_str(), std::ios::binary );
+      if ( !run.ifs.good() )
+      {
+        std::cerr << "Temporary file open error: " << fn << std::endl;
+        return false;
+      }
+      if ( read_record(run) )
+        heap.push(runs.size() - 1);
+      else if ( run.failed )
+      {
+        std::cerr << "Temporary file read error: " << fn << std::endl;
+        return false;
+      }
+    }
+    std::string key;
+    Value value;
+    bool has_key = false;
+    while ( !heap.empty() )
+    {
+      size_t idx = heap.top();
+      heap.pop();
+      auto& run = *runs[idx];
+      if ( has_key && run.key == key )
+        combine(value, run.value);
+      else
+      {
+        if ( has_key )
+          on_record(key, value);
+        key.swap(run.key);
+        value = std::move(run.value);
+        has_key = true;
+      }
+      if ( read_record(run) )
+        heap.push(idx);
+      else if ( run.failed )
+      {
+        std::cerr << "Temporary file read error: " << files[idx] << std::endl;
+        return false;
+      }
+    }
+    if ( has_key )
+      on_record(key, value);
+    return true;
+  } // method-end
+  // удаление файлов серий
+  void remove()
+  {
+    for (auto& fn : files)
+      std::remove( fn.c_str() );
+    files.clear();
+    bytes = 0;
+  } // method-end
+  // оценка накладных расходов на запись хэш-таблицы (узел, корзина, заголовок строки, значение)
+  static constexpr uint64_t ENTRY_OVERHEAD = 64;
+private:
+  std::string prefix;
+  uint64_t limit = 0;
+  uint64_t bytes = 0;
+  std::vector<std::string> files;
+
+  static void write_string(std::ostream& os, const std::string& str)
+  {
+    uint32_t len = str.size();
+    os.write( reinterpret_cast<const char*>(&len), sizeof(len) );
+    os.write( str.data(), len );
+  } // method-end
+  static bool read_string(std::istream& is, std::string& str)
+  {
+    uint32_t len = 0;
+    if ( !is.read( reinterpret_cast<char*>(&len), sizeof(len) ) )
+      return false;
+    str.resize(len);
+    return static_cast<bool>( is.read( &str[0], len ) );
+  } // method-end
+  static void write_value(std::ostream& os, uint64_t value)
+  {
+    os.write( reinterpret_cast<const char*>(&value), sizeof(value) );
+  } // method-end
+  static bool read_value(std::istream& is, uint64_t& value)
+  {
+    return static_cast<bool>( is.read( reinterpret_cast<char*>(&value), sizeof(value) ) );
+  } // method-end
+  static void write_value(std::ostream& os, const std::map<std::string, size_t>& value)
+  {
+    write_value(os, static_cast<uint64_t>(value.size()));
+    for (auto& record : value)
+    {
+      write_string(os, record.first);
+      write_value(os, static_cast<uint64_t>(record.second));
+    }
+  } // method-end
+  static bool read_value(std::istream& is, std::map<std::string, size_t>& value)
+  {
+    value.clear();
+    uint64_t cnt = 0;
+    if ( !read_value(is, cnt) )
+      return false;
+    std::string key;
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < cnt; ++i)
+    {
+      if ( !read_string(is, key) || !read_value(is, count) )
+        return false;
+      value.emplace_hint(value.end(), key, count);
+    }
+    return true;
+  } // method-end
+  static void combine(uint64_t& value, const uint64_t& other)
+  {
+    value += other;
+  } // method-end
+  static void combine(std::map<std::string, size_t>& value, const std::map<std::string, size_t>& other)
+  {
+    for (auto& record : other)
+      value[record.first] += record.second;
+  } // method-end
+  // чтение очередной записи серии (false -- серия закончилась; при ошибке чтения устанавливается run.failed)
+  template <typename Run>
+  static bool read_record(Run& run)
+  {
+    if ( run.ifs.peek() == std::char_traits<char>::eof() )
+      return false;
+    run.failed = !( read_string(run.ifs, run.key) && read_value(run.ifs, run.value) );
+    return !run.failed;
+  } // method-end
+}; // class-decl-end
+
+
+#endif /* VOCAB_SPILL_H_ */
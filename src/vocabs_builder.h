@@ -6,6 +6,10 @@
 #include "categoroid_vocab.h"
 #include "mwe_vocabulary.h"
 #include "original_word2vec_vocabulary.h"
+#include "bounded_queue.h"
+#include "heavy_hitters.h"
+#include "vocab_spill.h"
+#include "ostream_state_guard.h"
 
 #include <memory>
 #include <string>
@@ -15,26 +19,32 @@
 #include <set>
 #include <array>
 #include <fstream>
+#include <cstdio>
 #include <thread>
 #include <atomic>
 #include <mutex>
-#include <chrono>
+#include <cmath>
+#include <random>
+#include <numeric>
+#include <iomanip>
+#include <algorithm>
+#include <filesystem>
 
 // Класс, хранящий данные по чтению обучающих данных и выводящий прогресс-сообщения
+// (предложения могут учитываться из нескольких читающих потоков)
 class StatHelper
 {
 public:
   void calc_sentence(size_t cnt)
   {
-    tokens_processed += cnt;
-    tokens_dbg_counter += cnt;
-    if (tokens_dbg_counter >= 100000)
+    const uint64_t before = tokens_processed.fetch_add(cnt);
+    const uint64_t after = before + cnt;
+    if (after / 100000 != before / 100000)
     {
-      tokens_dbg_counter %= 100000;
-      if (tokens_processed >= 1000000)
-        std::cout << '\r' << (tokens_processed / 1000000) << " M        ";
+      if (after >= 1000000)
+        std::cout << '\r' << (after / 1000000) << " M        ";
       else
-        std::cout << '\r' << (tokens_processed / 1000) << " K        ";
+        std::cout << '\r' << (after / 1000) << " K        ";
       std::cout.flush();
     }
     if (cnt > 0)
@@ -47,51 +57,90 @@ public:
     std::cout << std::endl;
   }
 private:
-  uint64_t sentence_processed = 0;
-  uint64_t tokens_processed = 0;
-  size_t   tokens_dbg_counter = 0;
+  std::atomic<uint64_t> sentence_processed{0};
+  std::atomic<uint64_t> tokens_processed{0};
 };
 
 
-// Класс циклического буфера для предложений
-class SmCyclicBuf
+// Источник предложений для потока подсчета частот.
+// Либо очередь пакетов предложений (их читает отдельный поток -- для несмещаемого входа, например, stdin),
+// либо собственное чтение фрагментов корпуса: потоки разбирают номера фрагментов из общего списка, пока он не исчерпан.
+class SentenceSource
 {
 public:
-  SmCyclicBuf()
+  typedef ConllReader::SentenceMatrix SentenceMatrix;
+  typedef std::vector<SentenceMatrix> SentenceBatch;
+  typedef BoundedQueue<SentenceBatch> SentenceQueue;
+  explicit SentenceSource(SentenceQueue& sentence_queue)
+  : queue(&sentence_queue)
   {
-    for (auto i : buf)
-      i.reserve(2000);
   }
-  bool can_read() const
+  SentenceSource(const std::string& conll_fn, const std::vector<size_t>& chunks_list, size_t chunks_count,
+                 std::atomic<size_t>& next_chunk_counter, StatHelper& stat_helper)
+  : reader( std::make_unique<ConllReader>(conll_fn) )
+  , chunks(&chunks_list)
+  , chunks_cnt(chunks_count)
+  , next_chunk(&next_chunk_counter)
+  , stat(&stat_helper)
   {
-    return read_idx != write_idx;
   }
-  bool can_write() const
+  ~SentenceSource()
   {
-    return next(write_idx) != read_idx;
+    if ( reader )
+      reader->fin();
   }
-  void push(ConllReader::SentenceMatrix& sm)
+  // получение очередного предложения (false -- данные исчерпаны или произошла ошибка чтения)
+  bool next(SentenceMatrix& sentence_matrix)
   {
-    buf[write_idx].swap(sm);
-    write_idx = next(write_idx);
-  }
-  void pop(ConllReader::SentenceMatrix& sm)
+    if ( queue )
+    {
+      while ( batch_pos == batch.size() )
+      {
+        if ( !queue->pop(batch) )
+          return false;
+        batch_pos = 0;
+      }
+      sentence_matrix = std::move( batch[batch_pos++] );
+      return true;
+    }
+    while ( true )
+    {
+      if ( reader_active && reader->read_sentence(sentence_matrix) )
+      {
+        stat->calc_sentence( sentence_matrix.size() );
+        return true;
+      }
+      if ( reader_active )
+        reader->fin();
+      reader_active = false;
+      size_t idx = (*next_chunk)++;
+      if ( idx >= chunks->size() )
+        return false;
+      if ( !reader->init_chunk((*chunks)[idx], chunks_cnt) )
+      {
+        failed = true;
+        return false;
+      }
+      reader_active = true;
+    }
+  } // method-end
+  bool is_failed() const
   {
-    sm.swap(buf[read_idx]);
-    read_idx = next(read_idx);
-  }
+    return failed;
+  } // method-end
 private:
-  static constexpr size_t BUF_SIZE = 10;
-  std::array<ConllReader::SentenceMatrix, BUF_SIZE> buf;
-  size_t read_idx = 0;
-  size_t write_idx = 0;
-  size_t next(const size_t idx) const
-  {
-    size_t result = idx + 1;
-    if (result == BUF_SIZE)
-      result = 0;
-    return result;
-  }
+  // режим очереди
+  SentenceQueue* queue = nullptr;
+  SentenceBatch batch;
+  size_t batch_pos = 0;
+  // режим собственного чтения фрагментов
+  std::unique_ptr<ConllReader> reader;
+  const std::vector<size_t>* chunks = nullptr;
+  size_t chunks_cnt = 0;
+  std::atomic<size_t>* next_chunk = nullptr;
+  StatHelper* stat = nullptr;
+  bool reader_active = false;
+  bool failed = false;
 }; // class-decl-end
 
 
@@ -100,12 +149,38 @@ class VocabsBuilder
 {
 private:
   typedef ConllReader::SentenceMatrix SentenceMatrix;
+  typedef SentenceSource::SentenceBatch SentenceBatch;
+  typedef SentenceSource::SentenceQueue SentenceQueue;
   typedef std::unordered_map<std::string, uint64_t> VocabMapping;
   typedef std::shared_ptr<VocabMapping> VocabMappingPtr;
   typedef std::unordered_map<std::string, std::map<std::string, size_t>> Token2LemmasMap;
   typedef std::shared_ptr<Token2LemmasMap> Token2LemmasMapPtr;
   typedef std::shared_ptr<CategoroidsVocabulary> CategoroidsVocabularyPtr;
 public:
+  // включение приближенного построения словарей по выборке из корпуса
+  // fraction -- доля корпуса (по объему), z -- запас к частотным порогам в стандартных отклонениях оценки частоты
+  void set_sampling(float fraction, float z)
+  {
+    sample_fraction = fraction;
+    sample_z = z;
+  } // method-end
+  // включение однопроходного построения словарей
+  void set_single_pass(bool value)
+  {
+    single_pass = value;
+  } // method-end
+  // включение приближенного подсчета частот в ограниченной памяти
+  // memory_mb -- память под скетчи (0 -- точный подсчет), recount -- точный пересчет частот отобранных кандидатов дополнительным проходом
+  void set_memory_limit(size_t memory_mb, bool recount)
+  {
+    sketch_memory = static_cast<uint64_t>(memory_mb) * 1024 * 1024;
+    sketch_recount = recount;
+  } // method-end
+  // включение точного подсчета во внешней памяти: словари, превысившие memory_mb (на все словари прохода), сбрасываются на диск
+  void set_spill_limit(size_t memory_mb)
+  {
+    spill_memory = static_cast<uint64_t>(memory_mb) * 1024 * 1024;
+  } // method-end
   // построение всех словарей
   bool build_vocabs(const std::string& conll_fn,
                     const std::string& voc_l_fn, const std::string& voc_t_fn,
@@ -134,6 +209,25 @@ public:
       }
     }
 
+    // выбираем фрагменты корпуса для приближенного построения (оба прохода читают одну и ту же выборку)
+    if ( sample_fraction > 0 && !select_sample_chunks(conll_fn) )
+      return false;
+
+    // пороги отбора кандидатов при подсчете в ограниченной памяти (по частотам до масштабирования выборки)
+    sketch_lemma.threshold = raw_min_count( sampled_min_count(limit_l) );
+    sketch_lemma.coid_threshold = raw_min_count(COID_MIN_COUNT);
+    sketch_lemma.coid_vocab = coid_vocab;
+    sketch_token.threshold = raw_min_count( sampled_min_count(limit_t) );
+    sketch_oov.threshold = raw_min_count( sampled_min_count(limit_o) );
+    sketch_dep.threshold = raw_min_count( sampled_min_count(limit_d) );
+
+    // временные файлы сброса словарей на диск
+    spill_lemma.init(voc_l_fn + ".spill.l");
+    spill_token.init(voc_l_fn + ".spill.t");
+    spill_t2l.init(voc_l_fn + ".spill.tm");
+    spill_oov.init(voc_l_fn + ".spill.o");
+    spill_dep.init(voc_l_fn + ".spill.d");
+
     // ПРОХОД 1: строим главный словарь (включая словосочетания)
 
     // создаём и загружаем справочник словосочетаний
@@ -141,7 +235,12 @@ public:
         if ( !v_mwe->load(mwe_fn) )
           return false;
 
-    bool succ = build_main_vocab_only(conll_fn, voc_l_fn, limit_l, threads_cnt-1);
+    // в однопроходном режиме вместе с главным словарем подсчитываются и остальные (по предложениям, не содержащим словосочетаний);
+    // предложения со словосочетаниями откладываются во временный файл и обрабатываются после фильтрации справочника словосочетаний
+    const std::string deferred_fn = voc_l_fn + ".deferred";
+    bool succ = single_pass ? build_vocabs_single_pass( conll_fn, voc_l_fn, limit_l, deferred_fn,
+                                                        ctx_vocabulary_column_d, use_deprel, max_oov_sfx, threads_cnt )
+                            : build_main_vocab_only(conll_fn, voc_l_fn, limit_l, threads_cnt);
     if ( !succ ) return false;
 
     // ПРОХОД 2: строим остальные словари уже с учётом того, какие именно словосочетания преодолели частотный порог основного словаря
@@ -154,9 +253,11 @@ public:
     if ( !v_mwe->load(mwe_fn, v_lemmas) )
       return false;
 
-    succ = build_other_vocab_only( conll_fn, voc_t_fn, voc_tm_fn, voc_oov_fn, voc_d_fn,
+    succ = build_other_vocab_only( single_pass ? deferred_fn : conll_fn, voc_t_fn, voc_tm_fn, voc_oov_fn, voc_d_fn,
                                    limit_t, limit_o, limit_d,
-                                   ctx_vocabulary_column_d, use_deprel, max_oov_sfx, threads_cnt-1 );
+                                   ctx_vocabulary_column_d, use_deprel, max_oov_sfx, threads_cnt, !single_pass );
+    if ( single_pass )
+      std::remove( deferred_fn.c_str() );
     if ( !succ ) return false;
 
     return true;
@@ -166,6 +267,18 @@ private:
   const std::string OOV = "_OOV_";
   // минимальная длина слова, от которого берутся oov-суффиксы
   const size_t SFX_SOURCE_WORD_MIN_LEN = 6;
+  // потоки считают частоты в собственных словарях без блокировок и сливают их с общими словарями
+  // по окончании данных или при достижении этого размера (ограничение памяти на поток)
+  // (при сбросе словарей на диск -- чаще, чтобы локальные словари всех потоков в сумме не превышали ограничения памяти)
+  static constexpr size_t LOCAL_VOCAB_FLUSH_SIZE = 1 << 20;
+  static constexpr size_t LOCAL_VOCAB_MIN_FLUSH_SIZE = 1024;
+  size_t local_flush_size = LOCAL_VOCAB_FLUSH_SIZE;
+  // файловый корпус делится на фрагменты, которые потоки читают и обрабатывают параллельно (не менее CHUNKS_PER_THREAD на поток)
+  static constexpr uint64_t PARALLEL_CHUNK_BYTES = 16 * 1024 * 1024;
+  static constexpr size_t CHUNKS_PER_THREAD = 4;
+  // несмещаемый вход (stdin) читается одним потоком и передается потокам подсчета пакетами через очередь ограниченной емкости
+  static constexpr size_t SENTENCE_BATCH_SIZE = 256;
+  static constexpr size_t QUEUE_BATCHES_PER_WORKER = 4;
   // указатели на словари
   VocabMappingPtr vocab_lemma;
   VocabMappingPtr vocab_token;
@@ -174,199 +287,618 @@ private:
   VocabMappingPtr vocab_dep;
   std::shared_ptr< MweVocabulary > v_mwe;
   CategoroidsVocabularyPtr coid_vocab;
+  // слова из справочника категороидов сохраняются в главном словаре при частоте не ниже этой (независимо от -min-count_l)
+  static constexpr size_t COID_MIN_COUNT = 5;
+  // мьютексы словарей второго прохода
+  std::mutex tok_vocab_mtx, oov_vocab_mtx, dep_ctx_vocab_mtx;
+  // скетч словаря и порог отбора кандидатов (приближенный подсчет в ограниченной памяти)
+  struct SketchLimit
+  {
+    std::unique_ptr<HeavyHitters> hh;
+    uint64_t threshold = 1;
+    uint64_t coid_threshold = 1;            // порог для слов из справочника категороидов (главный словарь)
+    CategoroidsVocabularyPtr coid_vocab;
+    uint64_t get_threshold(const std::string& key) const
+    {
+      return ( coid_vocab && coid_vocab->in_words_list(key) ) ? std::min(threshold, coid_threshold) : threshold;
+    }
+  };
+  SketchLimit sketch_lemma, sketch_token, sketch_oov, sketch_dep;
+  // память под скетчи всех словарей, подсчитываемых за проход (0 -- точный подсчет)
+  uint64_t sketch_memory = 0;
+  // допустимая нагрузка скетча (средняя ячейка / порог); при большей нагрузке выводится предупреждение о насыщении
+  static constexpr double SKETCH_MAX_LOAD = 0.25;
+  // точный пересчет кандидатов дополнительным проходом (recount_mode -- идет пересчет)
+  bool sketch_recount = false;
+  bool recount_mode = false;
+  // сброс общих словарей на диск при превышении ограничения памяти (0 -- без сброса)
+  uint64_t spill_memory = 0;
+  VocabSpill spill_lemma, spill_token, spill_t2l, spill_oov, spill_dep;
+  std::atomic_bool spill_failed = false;
+  // частоты, подсчитываемые одним потоком (сливаются с общим словарем): при подсчете в ограниченной памяти
+  // учитываются только кандидаты скетча, при пересчете -- только ключи, уже имеющиеся в общем словаре
+  struct LocalVocab
+  {
+    VocabMapping map;
+    SketchLimit* sketch = nullptr;
+    const VocabMapping* known = nullptr;
+    // учет вхождения ключа (false -- вхождение не подсчитывается в словаре)
+    bool add(const std::string& key)
+    {
+      if ( known && known->find(key) == known->end() )
+        return false;
+      if ( sketch )
+      {
+        auto hit = sketch->hh->add( key, sketch->get_threshold(key) );
+        if ( hit == HeavyHitters::Hit::Below )
+          return false;
+        if ( hit == HeavyHitters::Hit::Crossed )
+        {
+          map.emplace(key, 0); // само вхождение уже учтено в скетче
+          return true;
+        }
+      }
+      auto it = map.find( key );
+      if (it == map.end())
+        map.emplace(key, 1);
+      else
+        ++it->second;
+      return true;
+    }
+  };
+  // частоты словарей второго прохода, подсчитанные одним потоком (сливаются с общими словарями)
+  struct OtherCounts
+  {
+    LocalVocab token, oov, dep;
+    Token2LemmasMap t2l;
+  };
+  // однопроходный режим построения словарей (отложенные предложения сбрасываются в файл порциями такого объема)
+  bool single_pass = false;
+  static constexpr size_t DEFERRED_BUF_SIZE = 1024 * 1024;
+  // параметры приближенного построения по выборке (sample_fraction == 0 -- точное построение по всему корпусу)
+  float sample_fraction = 0;
+  float sample_z = 2;
+  // корпус делится на sample_chunks_count фрагментов, из них читаются sample_chunks
+  static constexpr uint64_t SAMPLE_CHUNK_BYTES = 4 * 1024 * 1024;
+  static constexpr uint64_t SAMPLE_MIN_CHUNK_BYTES = 64 * 1024;
+  static constexpr size_t SAMPLE_MIN_CHUNKS = 200;
+  size_t sample_chunks_count = 0;
+  std::vector<size_t> sample_chunks;
+  // коэффициент масштабирования частот выборки на весь корпус
+  double sample_scale = 1.0;
+  // запас на погрешность оценки не снижает порог ниже этой доли от min-count
+  static constexpr double SAMPLE_MIN_THRESHOLD_FRACTION = 0.5;
+  // при большей относительной погрешности оценки частоты на пороге выводится предупреждение (выборка слишком мала)
+  static constexpr double SAMPLE_MAX_REL_ERROR = 0.25;
+
+  // суммарный объем корпуса (false -- корпус не является набором файлов, например, stdin)
+  bool corpus_size(const std::string& conll_fn, uint64_t& total_size)
+  {
+    total_size = 0;
+    std::vector<std::string> files;
+    if ( conll_fn == "stdin" || !CorpusShards::resolve(conll_fn, files) )
+      return false;
+    for (auto& fn : files)
+    {
+      std::error_code ec;
+      auto sz = std::filesystem::file_size(fn, ec);
+      if ( ec )
+      {
+        std::cerr << "Can't get file size for: " << fn << "\n  " << ec.message() << std::endl;
+        return false;
+      }
+      total_size += sz;
+    }
+    return true;
+  } // method-end
+  // выбор случайных фрагментов корпуса (равномерно, без повторений, с фиксированным зерном -- выборка воспроизводима)
+  bool select_sample_chunks(const std::string& conll_fn)
+  {
+    uint64_t total_size = 0;
+    if ( !corpus_size(conll_fn, total_size) )
+    {
+      std::cerr << "Sampled vocabulary building requires a seekable corpus: " << conll_fn << std::endl;
+      return false;
+    }
+    // на небольших корпусах фрагменты уменьшаются, чтобы выборка состояла из достаточного числа фрагментов
+    sample_chunks_count = std::max<uint64_t>(1, total_size / SAMPLE_CHUNK_BYTES);
+    if ( sample_chunks_count < SAMPLE_MIN_CHUNKS )
+      sample_chunks_count = std::max<uint64_t>(1, std::min<uint64_t>(SAMPLE_MIN_CHUNKS, total_size / SAMPLE_MIN_CHUNK_BYTES));
+    size_t k = std::llround(sample_fraction * sample_chunks_count);
+    k = std::min(std::max<size_t>(k, 1), sample_chunks_count);
+    std::vector<size_t> all_chunks(sample_chunks_count);
+    std::iota(all_chunks.begin(), all_chunks.end(), 0);
+    std::mt19937_64 rng(1);
+    for (size_t i = 0; i < k; ++i)
+      std::swap( all_chunks[i], all_chunks[i + rng() % (sample_chunks_count - i)] );
+    sample_chunks.assign(all_chunks.begin(), all_chunks.begin() + k);
+    std::sort(sample_chunks.begin(), sample_chunks.end());
+    sample_scale = static_cast<double>(sample_chunks_count) / k;
+    OstreamStateGuard cout_state(std::cout);
+    std::cout << "Vocabulary sampling: " << k << " of " << sample_chunks_count << " chunks ("
+              << std::fixed << std::setprecision(2) << 100.0 / sample_scale << "% of corpus), counts are scaled by "
+              << sample_scale << std::endl;
+    return true;
+  } // method-end
+  // выполнение прохода по корпусу: worker_func(SentenceSource&) вызывается в каждом потоке подсчета
+  // файловый корпус (или его выборка) читается самими потоками подсчета по фрагментам, stdin -- отдельным потоком через очередь
+  template <typename WorkerFunc>
+  bool run_pass(const std::string& conll_fn, size_t threads_cnt, bool use_sample, StatHelper& stat, WorkerFunc worker_func)
+  {
+    threads_cnt = std::max<size_t>(1, threads_cnt);
+    std::atomic_bool status = true;
+    const std::vector<size_t>* chunks = nullptr;
+    size_t chunks_count = 0;
+    std::vector<size_t> all_chunks;
+    uint64_t total_size = 0;
+    if ( use_sample && !sample_chunks.empty() )
+    {
+      chunks = &sample_chunks;
+      chunks_count = sample_chunks_count;
+    }
+    else if ( corpus_size(conll_fn, total_size) && total_size > 0 )
+    {
+      chunks_count = std::max<uint64_t>(threads_cnt * CHUNKS_PER_THREAD, total_size / PARALLEL_CHUNK_BYTES);
+      chunks_count = std::min<uint64_t>(chunks_count, std::max<uint64_t>(1, total_size / SAMPLE_MIN_CHUNK_BYTES));
+      all_chunks.resize(chunks_count);
+      std::iota(all_chunks.begin(), all_chunks.end(), 0);
+      chunks = &all_chunks;
+    }
+
+    std::vector<std::thread> threads_vec;
+    if ( chunks )
+    {
+      // параллельное чтение фрагментов
+      std::atomic<size_t> next_chunk(0);
+      threads_vec.reserve(threads_cnt);
+      for (size_t i = 0; i < threads_cnt; ++i)
+        threads_vec.emplace_back( [&] ()
+            {
+              SentenceSource source(conll_fn, *chunks, chunks_count, next_chunk, stat);
+              worker_func(source);
+              if ( source.is_failed() )
+              {
+                std::cerr << "Train-file read: error: " << conll_fn << std::endl;
+                status = false;
+              }
+            } );
+      for (auto& t : threads_vec)
+        t.join();
+      std::cout << std::endl;
+      stat.output_stat();
+      return status;
+    }
+
+    // один поток читает корпус, остальные подсчитывают частоты (но не менее одного)
+    const size_t workers_cnt = (threads_cnt > 1) ? threads_cnt - 1 : 1;
+    SentenceQueue queue(workers_cnt * QUEUE_BATCHES_PER_WORKER);
+    std::thread reading_thread( [&] ()
+        {
+          if ( !read_into_queue(conll_fn, stat, queue) )
+            status = false;
+        } );
+    threads_vec.reserve(workers_cnt);
+    for (size_t i = 0; i < workers_cnt; ++i)
+      threads_vec.emplace_back( [&] ()
+          {
+            SentenceSource source(queue);
+            worker_func(source);
+          } );
+    reading_thread.join();
+    for (auto& t : threads_vec)
+      t.join();
+    std::cout << std::endl;
+    stat.output_stat();
+    output_queue_stat(queue);
+    return status;
+  } // method-end
+  // последовательное чтение корпуса в очередь пакетами предложений (по окончании очередь закрывается)
+  bool read_into_queue(const std::string& conll_fn, StatHelper& stat, SentenceQueue& queue)
+  {
+    // открываем файл с тренировочными данными
+    ConllReader cr(conll_fn);
+    if ( !cr.init() )
+    {
+      std::cerr << "Train-file open: error: " << conll_fn << std::endl;
+      queue.close();
+      return false;
+    }
+    SentenceBatch batch;
+    batch.reserve(SENTENCE_BATCH_SIZE);
+    SentenceMatrix sentence_matrix;
+    while ( cr.read_sentence(sentence_matrix) )
+    {
+      stat.calc_sentence( sentence_matrix.size() );
+      batch.emplace_back( std::move(sentence_matrix) );
+      if ( batch.size() == SENTENCE_BATCH_SIZE )
+      {
+        queue.push( std::move(batch) );
+        batch = SentenceBatch();
+        batch.reserve(SENTENCE_BATCH_SIZE);
+      }
+    }
+    cr.fin();
+    if ( !batch.empty() )
+      queue.push( std::move(batch) );
+    queue.close();
+    return true;
+  } // method-end
+  // вывод статистики очереди предложений (частые ожидания писателя -- узкое место в подсчете, читателей -- в чтении)
+  void output_queue_stat(SentenceQueue& queue)
+  {
+    auto qs = queue.get_stats();
+    OstreamStateGuard cout_state(std::cout);
+    std::cout << "Queue: " << qs.pushes << " batches, avg depth " << std::fixed << std::setprecision(1) << qs.avg_depth()
+              << ", max depth " << qs.max_depth << ", reader waits " << qs.push_waits << ", workers waits " << qs.pop_waits << std::endl;
+    std::cout << std::endl;
+  } // method-end
+  // масштабирование частот выборки и вычисление порога с запасом на погрешность оценки
+  // частота слова в выборке приближенно распределена по Пуассону, поэтому стандартное отклонение оценки частоты
+  // слова с частотой около порога составляет sqrt(min_count * scale); порог снижается на sample_z таких отклонений,
+  // но не ниже min_count * SAMPLE_MIN_THRESHOLD_FRACTION; при слишком малой выборке выводится предупреждение
+  // (фрагменты -- это связные куски текста, поэтому для "кучно" встречающихся слов реальная погрешность выше)
+  size_t scale_sampled_vocab(VocabMappingPtr vocab, size_t min_count, Token2LemmasMapPtr t2l = nullptr)
+  {
+    if ( sample_chunks.empty() )
+      return min_count;
+    for (auto& record : *vocab)
+      record.second = std::llround(record.second * sample_scale);
+    if (t2l)
+      for (auto& record : *t2l)
+        for (auto& lemma : record.second)
+          lemma.second = std::llround(lemma.second * sample_scale);
+    const double sigma = std::sqrt(min_count * sample_scale);
+    const double margin = sample_z * sigma;
+    const size_t eff_min_count = sampled_min_count(min_count);
+    size_t near_cnt = 0;
+    for (auto& record : *vocab)
+      if ( std::fabs(record.second - static_cast<double>(min_count)) <= margin )
+        ++near_cnt;
+    const double rel_error = sigma / min_count;
+    OstreamStateGuard cout_state(std::cout);
+    std::cout << "  sampled estimate: min-count " << min_count << " -> " << eff_min_count
+              << ", relative error at threshold ~" << std::fixed << std::setprecision(1) << 100.0 * rel_error << "%"
+              << ", words near threshold: " << near_cnt << std::endl;
+    if ( rel_error > SAMPLE_MAX_REL_ERROR )
+    {
+      // относительная погрешность sqrt(scale / min_count) не превышает допустимой при доле выборки от 1 / (err^2 * min_count)
+      const double needed_fraction = std::min(1.0, 1.0 / (SAMPLE_MAX_REL_ERROR * SAMPLE_MAX_REL_ERROR * min_count));
+      std::cout << "  WARNING: the sample is too small for min-count " << min_count << ": relative error at threshold "
+                << 100.0 * rel_error << "% exceeds " << 100.0 * SAMPLE_MAX_REL_ERROR << "%, the threshold is lowered only to "
+                << eff_min_count << " and the vocabulary is unreliable near it; use -vocab_sample "
+                << std::setprecision(3) << needed_fraction << " or larger" << std::endl;
+    }
+    return eff_min_count;
+  } // method-end
+
+  // порог частоты (масштабированной на весь корпус) с запасом на погрешность оценки по выборке
+  size_t sampled_min_count(size_t min_count) const
+  {
+    if ( sample_chunks.empty() )
+      return min_count;
+    const double lowered = std::floor(min_count - sample_z * std::sqrt(min_count * sample_scale));
+    const double floor_value = std::ceil(min_count * SAMPLE_MIN_THRESHOLD_FRACTION);
+    return std::max( {1.0, lowered, floor_value} );
+  } // method-end
+  // порог частоты, подсчитанной по выборке (до масштабирования), не превышающий порога масштабированной частоты
+  uint64_t raw_min_count(size_t min_count) const
+  {
+    if ( sample_chunks.empty() )
+      return std::max<size_t>(1, min_count);
+    return std::max<double>(1.0, std::floor(min_count / sample_scale));
+  } // method-end
+  // создание скетчей словарей, подсчитываемых за проход (память делится между ними поровну; уже созданные скетчи сохраняются)
+  void init_sketches(const std::vector<SketchLimit*>& sketches)
+  {
+    if ( sketch_memory == 0 )
+      return;
+    for (auto s : sketches)
+      if ( !s->hh )
+        s->hh = std::make_unique<HeavyHitters>(sketch_memory / sketches.size());
+  } // method-end
+  // распределение ограничения памяти между словарями, подсчитываемыми за проход
+  void init_spills(const std::vector<VocabSpill*>& spills, size_t threads_cnt)
+  {
+    if ( spill_memory == 0 )
+      return;
+    const uint64_t limit = spill_memory / spills.size();
+    for (auto s : spills)
+      s->set_limit(limit);
+    local_flush_size = std::clamp<uint64_t>( limit / (std::max<size_t>(1, threads_cnt) * VocabSpill::ENTRY_OVERHEAD),
+                                             LOCAL_VOCAB_MIN_FLUSH_SIZE, LOCAL_VOCAB_FLUSH_SIZE );
+  } // method-end
+  // слияние сброшенных на диск серий с остатком словаря в памяти (в словаре остаются только записи, удовлетворяющие keep)
+  template <typename Map, typename KeepFunc>
+  bool merge_spilled(VocabSpill& spill, std::shared_ptr<Map> vocab, const std::string& name, KeepFunc keep)
+  {
+    if ( !spill.has_runs() )
+      return true;
+    bool succ = !spill_failed && spill.spill(*vocab);
+    if ( succ )
+    {
+      std::cout << "Merge " << spill.runs_count() << " spilled runs (" << name << ")..." << std::endl;
+      succ = spill.template merge<typename Map::mapped_type>( [&](const std::string& key, typename Map::mapped_type& value)
+          {
+            if ( keep(key, value) )
+              vocab->emplace(key, std::move(value));
+          } ); // func-end
+    }
+    spill.remove();
+    return succ;
+  } // method-end
+  // локальный словарь потока с учетом режима подсчета
+  LocalVocab make_local_vocab(SketchLimit& sketch, VocabMappingPtr vocab)
+  {
+    LocalVocab result;
+    if ( recount_mode )
+      result.known = vocab.get();
+    else if ( sketch.hh )
+      result.sketch = &sketch;
+    return result;
+  } // method-end
+  OtherCounts make_other_counts()
+  {
+    return OtherCounts{ make_local_vocab(sketch_token, vocab_token), make_local_vocab(sketch_oov, vocab_oov),
+                        make_local_vocab(sketch_dep, vocab_dep), Token2LemmasMap() };
+  } // method-end
+  // завершение подсчета по скетчу: к точным частотам кандидатов добавляются оценки вхождений, учтенных в скетче
+  // (получаются оценки частот сверху); при последующем пересчете кандидаты ниже порога отбрасываются, а частоты обнуляются
+  // возвращает false, если словарь подсчитывался точно
+  bool finish_sketch(SketchLimit& sketch, VocabMappingPtr vocab, const std::string& name)
+  {
+    if ( !sketch.hh || !vocab )
+      return false;
+    for (auto& record : *vocab)
+      record.second += sketch.hh->estimate(record.first);
+    // нагрузка скетча: средняя ошибка оценки в одной строке относительно порога
+    const double load = sketch.hh->get_mean_cell() / sketch.threshold;
+    OstreamStateGuard cout_state(std::cout);
+    std::cout << "Heavy hitters (" << name << "): sketch " << std::fixed << std::setprecision(1)
+              << sketch.hh->get_memory_size() / (1024.0 * 1024.0) << " MB, load " << std::setprecision(2) << load
+              << ", candidates " << vocab->size() << std::endl;
+    if ( load > SKETCH_MAX_LOAD )
+    {
+      // объем, при котором нагрузка не превысила бы допустимую (нагрузка обратно пропорциональна ширине скетча)
+      const double needed_mb = sketch_memory * load / SKETCH_MAX_LOAD / (1024.0 * 1024.0);
+      std::cout << "WARNING: heavy hitters sketch (" << name << ") is saturated (load " << load << " > " << SKETCH_MAX_LOAD << "): "
+                << "words well below the frequency threshold become candidates, and the candidates table is not bounded by -vocab_mem." << std::endl;
+      if ( sketch_recount )
+        std::cout << "    Frequencies will be recounted exactly, but increase -vocab_mem to about "
+                  << std::setprecision(0) << std::ceil(needed_mb) << " MB to keep memory bounded." << std::endl;
+      else
+        std::cout << "    The vocabulary contains extra words and overestimated frequencies; increase -vocab_mem to about "
+                  << std::setprecision(0) << std::ceil(needed_mb) << " MB or use -vocab_recount 1." << std::endl;
+    }
+    if ( sketch_recount )
+    {
+      for (auto it = vocab->begin(); it != vocab->end(); )
+      {
+        if ( it->second < sketch.get_threshold(it->first) )
+          it = vocab->erase(it);
+        else
+          (it++)->second = 0;
+      }
+    }
+    sketch.hh.reset();
+    return true;
+  } // method-end
+  // точный пересчет частот кандидатов (ключи общих словарей не добавляются, только подсчитываются)
+  template <typename WorkerFunc>
+  bool run_recount_pass(const std::string& conll_fn, size_t threads_cnt, bool use_sample, WorkerFunc worker_func)
+  {
+    std::cout << "Exact recount of candidates..." << std::endl;
+    StatHelper stat;
+    recount_mode = true;
+    bool status = run_pass(conll_fn, threads_cnt, use_sample, stat, worker_func);
+    recount_mode = false;
+    return status;
+  } // method-end
 
   // функция построения и сохранения главного словаря
   // выполняется отдельно, т.к. необходимо выяснить частоты словосочетаний (какие из них преодолевают частотный порог главного словаря и будут преобразовываться)
-  bool build_main_vocab_only(const std::string& conll_fn, const std::string& voc_l_fn, size_t limit_l, size_t workers_cnt)
+  bool build_main_vocab_only(const std::string& conll_fn, const std::string& voc_l_fn, size_t limit_l, size_t threads_cnt)
   {
     // в цикле читаем предложения из CoNLL-файла и извлекаем из них информацию для словаря
     StatHelper stat;
-    SmCyclicBuf cyclic_buf;
-    std::mutex mtx, vocab_mtx;
-    std::atomic_bool end_of_data = false;
-    std::atomic_bool status = true;
+    std::mutex vocab_mtx;
 
-    auto reading_thread_func = [&] ()
+    auto worker_func = [&] (SentenceSource& source)
         {
-          // открываем файл с тренировочными данными
-          ConllReader cr(conll_fn);
-          if ( !cr.init() )
-          {
-            std::cerr << "Train-file open: error: " << conll_fn << std::endl;
-            status = false;
-            end_of_data = true;
-            return;
-          }
-          // читаем и помещаем в циклический буфер (очередь на обработку)
+          LocalVocab local_lemma = make_local_vocab(sketch_lemma, vocab_lemma);
           SentenceMatrix sentence_matrix;
-          sentence_matrix.reserve(2000);
-          while ( cr.read_sentence(sentence_matrix) )
+          while ( source.next(sentence_matrix) )
           {
-            stat.calc_sentence( sentence_matrix.size() );
-            while ( true )
-            {
-              mtx.lock();
-              if ( !cyclic_buf.can_write() )
-              {
-                mtx.unlock();
-                std::this_thread::sleep_for(std::chrono::microseconds(1));
-                continue;
-              }
-              cyclic_buf.push(sentence_matrix);
-              mtx.unlock();
-              break;
-            }
+            v_mwe->put_phrases_into_sentence(sentence_matrix);
+            process_sentence_lemmas(local_lemma, sentence_matrix);
+            if ( local_lemma.map.size() >= local_flush_size )
+              merge_vocab(vocab_lemma, local_lemma, vocab_mtx, spill_lemma);
           }
-          cr.fin();
-          end_of_data = true;
+          merge_vocab(vocab_lemma, local_lemma, vocab_mtx, spill_lemma);
         }; // func-end
 
-    auto writing_thread_func = [&] ()
+    init_sketches({&sketch_lemma});
+    init_spills({&spill_lemma}, threads_cnt);
+    bool status = run_pass(conll_fn, threads_cnt, true, stat, worker_func);
+    // при слиянии отсекаются частоты ниже порога (пороги -- те же, что для отбора кандидатов скетча)
+    auto keep_lemma = [this](const std::string& key, uint64_t count) { return count >= sketch_lemma.get_threshold(key); };
+    status = merge_spilled(spill_lemma, vocab_lemma, "lemmas", keep_lemma) && status;
+    if ( finish_sketch(sketch_lemma, vocab_lemma, "lemmas") && sketch_recount )
+      status = run_recount_pass(conll_fn, threads_cnt, true, worker_func) && status;
+
+    // сохраняем словарь в файл
+    std::cout << "Save lemmas vocabulary..." << std::endl;
+    reduce_vocab(vocab_lemma, scale_sampled_vocab(vocab_lemma, limit_l), coid_vocab);
+    save_vocab(vocab_lemma, voc_l_fn);
+    return status;
+  } // method-end
+
+  // однопроходное построение: главный словарь строится и сохраняется, остальные подсчитываются по предложениям без словосочетаний
+  // (на них фильтрация справочника словосочетаний по главному словарю не влияет), а предложения, в которых словосочетания
+  // сопоставились, сохраняются в файл deferred_fn для досчета после фильтрации
+  bool build_vocabs_single_pass( const std::string& conll_fn, const std::string& voc_l_fn, size_t limit_l, const std::string& deferred_fn,
+                                 size_t ctx_vocabulary_column_d, bool use_deprel, size_t max_oov_sfx, size_t threads_cnt )
+  {
+    StatHelper stat;
+    std::mutex vocab_mtx, deferred_mtx;
+    std::atomic<uint64_t> deferred_cnt(0);
+
+    std::ofstream deferred_ofs( deferred_fn.c_str(), std::ios::binary );
+    if ( !deferred_ofs.good() )
+    {
+      std::cerr << "Can't create temporary file: " << deferred_fn << std::endl;
+      return false;
+    }
+
+    auto worker_func = [&] (SentenceSource& source)
         {
-          SentenceMatrix sentence_matrix;
-          sentence_matrix.reserve(2000);
-          while ( true )
+          LocalVocab local_lemma = make_local_vocab(sketch_lemma, vocab_lemma);
+          OtherCounts local = make_other_counts();
+          SentenceMatrix sentence_matrix, original;
+          std::string deferred_buf;
+          auto flush_deferred = [&] ()
+              {
+                const std::lock_guard<std::mutex> lock(deferred_mtx);
+                deferred_ofs << deferred_buf;
+                deferred_buf.clear();
+              }; // func-end
+          while ( source.next(sentence_matrix) )
           {
-            mtx.lock();
-            if ( !cyclic_buf.can_read() )
+            // без кандидатов в словосочетания предложение не меняется ни при каком справочнике словосочетаний
+            bool has_mwe = v_mwe->has_candidates(sentence_matrix);
+            if ( has_mwe )
             {
-              mtx.unlock();
-              if ( end_of_data )
-                break;
-              else {
-                std::this_thread::sleep_for(std::chrono::microseconds(1));
-                continue;
-              }
+              original = sentence_matrix;
+              v_mwe->put_phrases_into_sentence(sentence_matrix);
+              has_mwe = (sentence_matrix != original);
             }
-            cyclic_buf.pop( sentence_matrix );
-            mtx.unlock();
-            v_mwe->put_phrases_into_sentence(sentence_matrix);
-            process_sentence_lemmas(vocab_lemma, sentence_matrix, vocab_mtx);
+            process_sentence_lemmas(local_lemma, sentence_matrix);
+            if ( local_lemma.map.size() >= local_flush_size )
+              merge_vocab(vocab_lemma, local_lemma, vocab_mtx, spill_lemma);
+            if ( has_mwe )
+            {
+              append_sentence(deferred_buf, original);
+              ++deferred_cnt;
+              if ( deferred_buf.size() >= DEFERRED_BUF_SIZE )
+                flush_deferred();
+            }
+            else
+              count_other(local, sentence_matrix, ctx_vocabulary_column_d, use_deprel, max_oov_sfx);
           }
-        };
-
-    std::thread reading_thread(reading_thread_func);
-    std::vector<std::thread> threads_vec;
-    threads_vec.reserve(workers_cnt);
-    for (size_t i = 0; i < workers_cnt; ++i)
-      threads_vec.emplace_back(writing_thread_func);
+          flush_deferred();
+          merge_vocab(vocab_lemma, local_lemma, vocab_mtx, spill_lemma);
+          merge_other(local, false);
+        }; // func-end
 
-    reading_thread.join();
-    for (size_t i = 0; i < workers_cnt; ++i)
-      threads_vec[i].join();
+    // скетчи остальных словарей продолжают использоваться при досчете отложенных предложений
+    if ( vocab_oov )
+    {
+      init_sketches({&sketch_lemma, &sketch_token, &sketch_oov, &sketch_dep});
+      init_spills({&spill_lemma, &spill_token, &spill_t2l, &spill_oov, &spill_dep}, threads_cnt);
+    }
+    else
+    {
+      init_sketches({&sketch_lemma, &sketch_token, &sketch_dep});
+      init_spills({&spill_lemma, &spill_token, &spill_t2l, &spill_dep}, threads_cnt);
+    }
+    bool status = run_pass(conll_fn, threads_cnt, true, stat, worker_func);
+    finish_sketch(sketch_lemma, vocab_lemma, "lemmas");
+    auto keep_lemma = [this](const std::string& key, uint64_t count) { return count >= sketch_lemma.get_threshold(key); };
+    status = merge_spilled(spill_lemma, vocab_lemma, "lemmas", keep_lemma) && status;
+    deferred_ofs.close();
+    if ( deferred_ofs.fail() )
+    {
+      std::cerr << "Temporary file write error: " << deferred_fn << std::endl;
+      status = false;
+    }
 
-    // выводим стат.данные
-    std::cout << std::endl;
-    stat.output_stat();
+    std::cout << "Sentences with multiword expressions (deferred): " << deferred_cnt << std::endl;
     // сохраняем словарь в файл
     std::cout << "Save lemmas vocabulary..." << std::endl;
-    reduce_vocab(vocab_lemma, limit_l, coid_vocab);
+    reduce_vocab(vocab_lemma, scale_sampled_vocab(vocab_lemma, limit_l), coid_vocab);
     save_vocab(vocab_lemma, voc_l_fn);
     return status;
   } // method-end
+  // сериализация предложения в conll-формате
+  void append_sentence(std::string& buf, const SentenceMatrix& data)
+  {
+    for (auto& t : data)
+    {
+      for (size_t i = 0; i < t.size(); ++i)
+      {
+        if ( i > 0 ) buf += '\t';
+        buf += t[i];
+      }
+      buf += '\n';
+    }
+    buf += '\n';
+  } // method-end
 
   // функция построения и сохранения остальных словарей
   bool build_other_vocab_only( const std::string& conll_fn,
                                const std::string& voc_t_fn, const std::string& voc_tm_fn, const std::string& voc_oov_fn, const std::string& voc_d_fn,
                                size_t limit_t, size_t limit_o, size_t limit_d,
-                               size_t ctx_vocabulary_column_d, bool use_deprel, size_t max_oov_sfx, size_t workers_cnt)
+                               size_t ctx_vocabulary_column_d, bool use_deprel, size_t max_oov_sfx, size_t threads_cnt, bool use_sample)
   {
     // в цикле читаем предложения из CoNLL-файла и извлекаем из них информацию для словаря
     StatHelper stat;
-    SmCyclicBuf cyclic_buf;
-    std::mutex mtx, tok_vocab_mtx, oov_vocab_mtx, dep_ctx_vocab_mtx;
-    std::atomic_bool end_of_data = false;
-    std::atomic_bool status = true;
 
-    auto reading_thread_func = [&] ()
+    auto worker_func = [&] (SentenceSource& source)
         {
-          // открываем файл с тренировочными данными
-          ConllReader cr(conll_fn);
-          if ( !cr.init() )
-          {
-            std::cerr << "Train-file open: error: " << conll_fn << std::endl;
-            status = false;
-            end_of_data = true;
-            return;
-          }
-          // читаем и помещаем в циклический буфер (очередь на обработку)
+          OtherCounts local = make_other_counts();
           SentenceMatrix sentence_matrix;
-          sentence_matrix.reserve(2000);
-          while ( cr.read_sentence(sentence_matrix) )
+          while ( source.next(sentence_matrix) )
           {
-            stat.calc_sentence( sentence_matrix.size() );
-            while ( true )
-            {
-              mtx.lock();
-              if ( !cyclic_buf.can_write() )
-              {
-                mtx.unlock();
-                std::this_thread::sleep_for(std::chrono::microseconds(1));
-                continue;
-              }
-              cyclic_buf.push(sentence_matrix);
-              mtx.unlock();
-              break;
-            }
-          }
-          cr.fin();
-          end_of_data = true;
-        }; // func-end
-
-    auto writing_thread_func = [&] ()
-        {
-          SentenceMatrix sentence_matrix;
-          sentence_matrix.reserve(2000);
-          while ( true )
-          {
-            mtx.lock();
-            if ( !cyclic_buf.can_read() )
-            {
-              mtx.unlock();
-              if ( end_of_data )
-                break;
-              else {
-                std::this_thread::sleep_for(std::chrono::microseconds(1));
-                continue;
-              }
-            }
-            cyclic_buf.pop( sentence_matrix );
-            mtx.unlock();
             v_mwe->put_phrases_into_sentence(sentence_matrix);
-            process_sentence_tokens(vocab_token, token2lemmas_map, sentence_matrix, tok_vocab_mtx);
-            if (vocab_oov)
-              process_sentence_oov(vocab_oov, sentence_matrix, max_oov_sfx, oov_vocab_mtx);
-            process_sentence_dep_ctx(vocab_dep, sentence_matrix, ctx_vocabulary_column_d, use_deprel, dep_ctx_vocab_mtx);
+            count_other(local, sentence_matrix, ctx_vocabulary_column_d, use_deprel, max_oov_sfx);
           }
-        };
-
-    std::thread reading_thread(reading_thread_func);
-    std::vector<std::thread> threads_vec;
-    threads_vec.reserve(workers_cnt);
-    for (size_t i = 0; i < workers_cnt; ++i)
-      threads_vec.emplace_back(writing_thread_func);
+          merge_other(local, false);
+        }; // func-end
 
-    reading_thread.join();
-    for (size_t i = 0; i < workers_cnt; ++i)
-      threads_vec[i].join();
+    if ( vocab_oov )
+    {
+      init_sketches({&sketch_token, &sketch_oov, &sketch_dep});
+      init_spills({&spill_token, &spill_t2l, &spill_oov, &spill_dep}, threads_cnt);
+    }
+    else
+    {
+      init_sketches({&sketch_token, &sketch_dep});
+      init_spills({&spill_token, &spill_t2l, &spill_dep}, threads_cnt);
+    }
+    bool status = run_pass(conll_fn, threads_cnt, use_sample, stat, worker_func);
+    // слияние сброшенных на диск словарей с отсечением по частотным порогам (отображение в леммы -- только для оставшихся токенов);
+    // фильтры по стоп-словам и представительности oov-суффиксов применяются далее к уже отфильтрованным словарям
+    auto keep_token = [this](const std::string& key, uint64_t count) { return count >= sketch_token.get_threshold(key); };
+    status = merge_spilled(spill_token, vocab_token, "tokens", keep_token) && status;
+    auto keep_t2l = [this](const std::string& key, const std::map<std::string, size_t>&) { return vocab_token->count(key) > 0; };
+    status = merge_spilled(spill_t2l, token2lemmas_map, "tokens to lemmas", keep_t2l) && status;
+    auto keep_oov = [this](const std::string& key, uint64_t count) { return count >= sketch_oov.get_threshold(key); };
+    if ( vocab_oov )
+      status = merge_spilled(spill_oov, vocab_oov, "oov", keep_oov) && status;
+    auto keep_dep = [this](const std::string& key, uint64_t count) { return count >= sketch_dep.get_threshold(key); };
+    status = merge_spilled(spill_dep, vocab_dep, "dependency contexts", keep_dep) && status;
+    bool sketched = finish_sketch(sketch_token, vocab_token, "tokens");
+    sketched = finish_sketch(sketch_oov, vocab_oov, "oov") || sketched;
+    sketched = finish_sketch(sketch_dep, vocab_dep, "dependency contexts") || sketched;
+    if ( sketched && sketch_recount )
+    {
+      token2lemmas_map->clear();
+      status = run_recount_pass(conll_fn, threads_cnt, use_sample, worker_func) && status;
+    }
 
-    // выводим стат.данные
-    std::cout << std::endl;
-    stat.output_stat();
     // сохраняем словари в файлах
     std::cout << "Save tokens vocabulary..." << std::endl;
     erase_toks_stopwords(vocab_token); // todo:  УБРАТЬ! временный доп.фильтр для борьбы с ошибками токенизации
-    reduce_vocab(vocab_token, limit_t);
+    reduce_vocab(vocab_token, scale_sampled_vocab(vocab_token, limit_t, token2lemmas_map));
     save_vocab(vocab_token, voc_t_fn, token2lemmas_map, voc_tm_fn);
     if (vocab_oov)
     {
       std::cout << "Save OOV vocabulary..." << std::endl;
       oov_idf_filter(vocab_oov, vocab_token, max_oov_sfx);
-      reduce_vocab(vocab_oov, limit_o);
+      reduce_vocab(vocab_oov, scale_sampled_vocab(vocab_oov, limit_o));
       save_vocab(vocab_oov, voc_oov_fn);
     }
     std::cout << "Save dependency contexts vocabulary..." << std::endl;
-    reduce_vocab(vocab_dep, limit_d);
+    reduce_vocab(vocab_dep, scale_sampled_vocab(vocab_dep, limit_d));
     save_vocab(vocab_dep, voc_d_fn);
     return status;
   } // method-end
@@ -459,7 +991,82 @@ private:
         it = oov_vocab->erase(it);
     }
   } // method-end
-  void process_sentence_lemmas(VocabMappingPtr vocab, const SentenceMatrix& sentence, std::mutex& vocab_mtx)
+  // подсчет частот словарей второго прохода по предложению (словосочетания уже встроены)
+  void count_other(OtherCounts& oc, const SentenceMatrix& sentence_matrix, size_t ctx_vocabulary_column_d, bool use_deprel, size_t max_oov_sfx)
+  {
+    process_sentence_tokens(oc.token, oc.t2l, sentence_matrix);
+    if (vocab_oov)
+      process_sentence_oov(oc.oov, sentence_matrix, max_oov_sfx);
+    process_sentence_dep_ctx(oc.dep, sentence_matrix, ctx_vocabulary_column_d, use_deprel);
+    merge_other(oc, true);
+  } // method-end
+  // слияние частот второго прохода с общими словарями (only_full -- только переполненных локальных словарей)
+  void merge_other(OtherCounts& oc, bool only_full)
+  {
+    if ( !only_full || oc.token.map.size() >= local_flush_size || oc.t2l.size() >= local_flush_size )
+    {
+      merge_vocab(vocab_token, oc.token, tok_vocab_mtx, spill_token);
+      merge_t2l(token2lemmas_map, oc.t2l, tok_vocab_mtx, spill_t2l);
+    }
+    if ( vocab_oov && (!only_full || oc.oov.map.size() >= local_flush_size) )
+      merge_vocab(vocab_oov, oc.oov, oov_vocab_mtx, spill_oov);
+    if ( !only_full || oc.dep.map.size() >= local_flush_size )
+      merge_vocab(vocab_dep, oc.dep, dep_ctx_vocab_mtx, spill_dep);
+  } // method-end
+  // слияние частот, подсчитанных потоком, с общим словарем (узлы переносятся без копирования строк; локальный словарь очищается)
+  // общий словарь, превысивший ограничение памяти, сбрасывается на диск
+  void merge_vocab(VocabMappingPtr vocab, LocalVocab& local_vocab, std::mutex& vocab_mtx, VocabSpill& spill)
+  {
+    auto& local = local_vocab.map;
+    const std::lock_guard<std::mutex> lock(vocab_mtx);
+    if ( local_vocab.known )
+    {
+      // при пересчете общий словарь не изменяется структурно (другие потоки ищут в нем ключи без блокировки)
+      for (auto& record : local)
+        vocab->find(record.first)->second += record.second;
+      local.clear();
+      return;
+    }
+    for (auto it = local.begin(); it != local.end(); )
+    {
+      auto node = local.extract(it++);
+      auto res = vocab->insert( std::move(node) );
+      if ( !res.inserted )
+        res.position->second += res.node.mapped();
+      else
+        spill.add_bytes(res.position->first);
+    }
+    if ( spill.over_limit() && !spill.spill(*vocab) )
+      spill_failed = true;
+  } // method-end
+  void merge_t2l(Token2LemmasMapPtr t2l, Token2LemmasMap& local, std::mutex& vocab_mtx, VocabSpill& spill)
+  {
+    const std::lock_guard<std::mutex> lock(vocab_mtx);
+    for (auto it = local.begin(); it != local.end(); )
+    {
+      auto node = local.extract(it++);
+      auto res = t2l->insert( std::move(node) );
+      if ( !res.inserted )
+      {
+        for (auto& lemma : res.node.mapped())
+        {
+          auto lres = res.position->second.emplace(lemma.first, 0);
+          if ( lres.second )
+            spill.add_bytes(lemma.first);
+          lres.first->second += lemma.second;
+        }
+      }
+      else
+      {
+        spill.add_bytes(res.position->first);
+        for (auto& lemma : res.position->second)
+          spill.add_bytes(lemma.first);
+      }
+    }
+    if ( spill.over_limit() && !spill.spill(*t2l) )
+      spill_failed = true;
+  } // method-end
+  void process_sentence_lemmas(LocalVocab& vocab, const SentenceMatrix& sentence)
   {
     for ( auto& token : sentence )
     {
@@ -467,18 +1074,10 @@ private:
         continue;
       if ( token[Conll::LEMMA] == "_" ) // символ отсутствия значения в conll
         continue;
-      auto& word = token[Conll::LEMMA];
-      {
-        const std::lock_guard<std::mutex> lock(vocab_mtx);
-        auto it = vocab->find( word );
-        if (it == vocab->end())
-          (*vocab)[word] = 1;
-        else
-          ++it->second;
-      } // lock scope end
+      vocab.add( token[Conll::LEMMA] );
     } // for all tokens
   } // method-end
-  void process_sentence_tokens(VocabMappingPtr vocab, Token2LemmasMapPtr token2lemmas_map, const SentenceMatrix& sentence, std::mutex& vocab_mtx)
+  void process_sentence_tokens(LocalVocab& vocab, Token2LemmasMap& token2lemmas_map, const SentenceMatrix& sentence)
   {
     for ( auto& token : sentence )
     {
@@ -486,24 +1085,19 @@ private:
         continue;
       if ( token[Conll::FORM] == "_" || token[Conll::LEMMA] == "_" )   // символ отсутствия значения в conll
         continue;
-      auto word = token[Conll::FORM];
-      {
-        const std::lock_guard<std::mutex> lock(vocab_mtx);
-        auto it = vocab->find( word );
-        if (it == vocab->end())
-          (*vocab)[word] = 1;
-        else
-          ++it->second;
+      auto& word = token[Conll::FORM];
+      if ( !vocab.add(word) )   // отношение токен-лемма подсчитывается только для подсчитываемых токенов
+        continue;
 
-        auto itt = (*token2lemmas_map)[word].find( token[Conll::LEMMA] );
-        if ( itt == (*token2lemmas_map)[word].end() )
-          (*token2lemmas_map)[word][token[Conll::LEMMA]] = 1;
-        else
-          ++itt->second;
-      } // lock scope end
+      auto& lemmas = token2lemmas_map[word];
+      auto itt = lemmas.find( token[Conll::LEMMA] );
+      if ( itt == lemmas.end() )
+        lemmas[token[Conll::LEMMA]] = 1;
+      else
+        ++itt->second;
     } // for all tokens
   } // method-end
-  void process_sentence_oov(VocabMappingPtr vocab, const SentenceMatrix& sentence, size_t max_oov_sfx, std::mutex& vocab_mtx)
+  void process_sentence_oov(LocalVocab& vocab, const SentenceMatrix& sentence, size_t max_oov_sfx)
   {
     for ( auto& token : sentence )
     {
@@ -522,8 +1116,7 @@ private:
       // вариант "первая буква, последняя цифра"
       if ( RuLets.find(word.front()) != std::u32string::npos && Digs.find(word.back()) != std::u32string::npos )
       {
-        const std::lock_guard<std::mutex> lock(vocab_mtx);
-        (*vocab)[OOV+"LD_"] += 1;
+        vocab.add(OOV+"LD_");
         continue;
       }
       // вариант "кириллический суффикс"
@@ -541,12 +1134,11 @@ private:
         if (!isCyr)
           break;
         sfx = StrConv::To_UTF8(std::u32string(1, letter)) + sfx;
-        const std::lock_guard<std::mutex> lock(vocab_mtx);
-        (*vocab)[OOV+sfx] += 1;
+        vocab.add(OOV+sfx);
       }
     } // for all tokens in sentence
   } // method-end
-  void process_sentence_dep_ctx(VocabMappingPtr vocab, const SentenceMatrix& sentence, size_t column, bool use_deprel, std::mutex& vocab_mtx)
+  void process_sentence_dep_ctx(LocalVocab& vocab, const SentenceMatrix& sentence, size_t column, bool use_deprel)
   {
     for (auto& token : sentence)
     {
@@ -570,26 +1162,13 @@ private:
         if ( parent[column] == "_" && parent[Conll::MISC] != "STUB" ) // символ отсутствия значения в conll
           continue;
 
+        // рассматриваем контекст с точки зрения родителя в синтаксической связи
+        if ( parent[Conll::MISC] != "STUB" )
         {
-          const std::lock_guard<std::mutex> lock(vocab_mtx);
-          // рассматриваем контекст с точки зрения родителя в синтаксической связи
-          if ( parent[Conll::MISC] != "STUB" )
-          {
-            auto ctx__from_head_viewpoint = token[column] + "<" + token[Conll::DEPREL];
-            auto it_h = vocab->find( ctx__from_head_viewpoint );
-            if (it_h == vocab->end())
-              (*vocab)[ctx__from_head_viewpoint] = 1;
-            else
-              ++it_h->second;
-          }
-          // рассматриваем контекст с точки зрения потомка в синтаксической связи
-          auto ctx__from_child_viewpoint = parent[column] + ">" + token[Conll::DEPREL];
-          auto it_c = vocab->find( ctx__from_child_viewpoint );
-          if (it_c == vocab->end())
-            (*vocab)[ctx__from_child_viewpoint] = 1;
-          else
-            ++it_c->second;
-        } // lock scope end
+          vocab.add( token[column] + "<" + token[Conll::DEPREL] );
+        }
+        // рассматриваем контекст с точки зрения потомка в синтаксической связи
+        vocab.add( parent[column] + ">" + token[Conll::DEPREL] );
       }
       else
       {
@@ -597,15 +1176,7 @@ private:
           continue;
         if ( token[column] == "_" ) // символ отсутствия значения в conll
           continue;
-        auto& word = token[column];
-        {
-          const std::lock_guard<std::mutex> lock(vocab_mtx);
-          auto it = vocab->find( word );
-          if (it == vocab->end())
-            (*vocab)[word] = 1;
-          else
-            ++it->second;
-        } // lock scope end
+        vocab.add( token[column] );
       } // if ( use_depre ) then ... else ...
     } // for all tokens
   } // method-end
@@ -649,7 +1220,7 @@ private:
         ++it;
       else
       {
-        if (coid_vocab && it->second >= 5 && coid_vocab->in_words_list(it->first))
+        if (coid_vocab && it->second >= COID_MIN_COUNT && coid_vocab->in_words_list(it->first))
           ++it;
         else
           it = vocab->erase(it);